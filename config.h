@@ -76,6 +76,20 @@ extern "C" {
 #define HAVE_STRNICMP           0
 #endif
 
+/* ======== number profile ======== */
+/* numbers are int64 mantissa with decimal exponent, parameter and result
+ * paths use no floating point (targets without FPU) */
+#ifndef SCPI_USE_FIXED_POINT
+#define SCPI_USE_FIXED_POINT    0
+#endif
+
+/* ======== coroutine command handlers ======== */
+/* needs C++20, has to be the same in all sources, because it changes
+ * scpi_command_t (CONFIG += scpi_coroutines in qmake) */
+#ifndef SCPI_USE_COROUTINES
+#define SCPI_USE_COROUTINES     0
+#endif
+
 /* define local macros depending on existance of strnlen */
 #if HAVE_STRNLEN
 #define SCPI_strnlen(s, l)	strnlen((s), (l))
@@ -43,18 +43,32 @@
 #define LIST_OF_ERRORS \
     X(SCPI_ERROR_SYNTAX,               -102, "Syntax error")                   \
     X(SCPI_ERROR_INVALID_SEPARATOR,    -103, "Invalid separator")              \
+    X(SCPI_ERROR_DATA_TYPE_ERROR,      -104, "Data type error")                \
     X(SCPI_ERROR_UNDEFINED_HEADER,     -113, "Undefined header")               \
     X(SCPI_ERROR_PARAMETER_NOT_ALLOWED,-108, "Parameter not allowed")          \
     X(SCPI_ERROR_MISSING_PARAMETER,    -109, "Missing parameter")              \
     X(SCPI_ERROR_INVALID_SUFFIX,       -131, "Invalid suffix")                 \
     X(SCPI_ERROR_SUFFIX_NOT_ALLOWED,   -138, "Suffix not allowed")             \
     X(SCPI_ERROR_EXECUTION_ERROR,      -200, "Execution error")                \
+    X(SCPI_ERROR_DATA_OUT_OF_RANGE,    -222, "Data out of range")              \
+    X(SCPI_ERROR_TOO_MUCH_DATA,        -223, "Too much data")                  \
     X(SCPI_ERROR_ILLEGAL_PARAMETER_VALUE,-224,"Illegal parameter value")       \
+    X(SCPI_ERROR_QUEUE_OVERFLOW,       -350, "Queue overflow")                 \
+    X(SCPI_ERROR_INPUT_BUFFER_OVERRUN, -363, "Input buffer overrun")           \
+    X(SCPI_ERROR_QUERY_INTERRUPTED,    -410, "Query INTERRUPTED")              \
+    X(SCPI_ERROR_QUERY_UNTERMINATED,   -420, "Query UNTERMINATED")             \
+    X(SCPI_ERROR_QUERY_DEADLOCKED,     -430, "Query DEADLOCKED")               \
 
+/* device specific errors, define before including this file, e.g.
+ * #define LIST_OF_USER_ERRORS X(MY_ERROR_OVERLOAD, 100, "Overload") */
+#ifndef LIST_OF_USER_ERRORS
+#define LIST_OF_USER_ERRORS
+#endif
 
 enum {
 #define X(def, val, str) def = val,
 LIST_OF_ERRORS
+LIST_OF_USER_ERRORS
 #undef X
 };
 
@@ -17,14 +17,10 @@ TEMPLATE = app
 
 SOURCES += main.cpp \
     scpiparser.cpp \
-    utils.c
+    scpidevicebinding.cpp
 
 HEADERS += \
     scpiparser.h \
-    types.h \
-    config.h \
-    constants.h \
-    error.h \
-    ieee488.h \
-    utils_private.h \
-    fifo.h
+    scpidevicebinding.h
+
+include(scpicore.pri)
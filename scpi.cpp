@@ -0,0 +1,273 @@
+#include <new>
+
+#include "scpi.h"
+#include "scpicore.h"
+
+/* commands every session answers, after commands of the device */
+static const SCPICore::scpi_command_t scpi_common_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+/* handlers - C handler of every command of cmdlist, NULL for common ones */
+struct scpi_device {
+    SCPICore::scpi_instrument_t instrument;
+    SCPICore::scpi_command_t * cmdlist;
+    scpi_handler_t * handlers;
+    void * user_context;
+};
+
+/* session calls C handlers through one member function, which finds the
+ * handler by position of the matched command */
+struct scpi_session : public SCPISession {
+    scpi_device_t * device;
+    void * user_context;
+
+    scpi_session(scpi_device_t * device, void * user_context) :
+        SCPISession(&device->instrument),
+        device(device),
+        user_context(user_context)
+    {
+    }
+
+    scpi_result_t handlerCall() {
+        size_t index = context.paramlist.cmd - device->cmdlist;
+        return (scpi_result_t) device->handlers[index](this);
+    }
+};
+
+/**
+ * Create instrument definition
+ * @param handlers - command patterns and handlers, ends by SCPI_HANDLERS_END
+ * @param user_context
+ * @return device or NULL if out of memory
+ */
+scpi_device_t * scpi_device_new(const scpi_handler_def_t * handlers, void * user_context) {
+    scpi_device_t * device;
+    size_t n;
+    size_t common;
+    size_t i;
+
+    for (n = 0; handlers[n].pattern != NULL; n++) {
+    }
+    for (common = 0; scpi_common_commands[common].pattern != NULL; common++) {
+    }
+
+    device = new (std::nothrow) scpi_device_t;
+    if (device == NULL) {
+        return NULL;
+    }
+    device->cmdlist = new (std::nothrow) SCPICore::scpi_command_t[n + common + 1]();
+    device->handlers = new (std::nothrow) scpi_handler_t[n + common + 1]();
+    if (device->cmdlist == NULL || device->handlers == NULL) {
+        delete[] device->cmdlist;
+        delete[] device->handlers;
+        delete device;
+        return NULL;
+    }
+
+    for (i = 0; i < n; i++) {
+        device->cmdlist[i].pattern = handlers[i].pattern;
+        device->cmdlist[i].callback = static_cast<SCPICore::scpi_command_callback_t>(&scpi_session::handlerCall);
+        device->handlers[i] = handlers[i].handler;
+    }
+    for (i = 0; i <= common; i++) {
+        device->cmdlist[n + i] = scpi_common_commands[i];
+    }
+    device->user_context = user_context;
+
+    SCPICore::SCPI_InstrumentInit(&device->instrument, device->cmdlist);
+    return device;
+}
+
+/**
+ * Free instrument definition, all its sessions have to be freed before
+ * @param device
+ */
+void scpi_device_free(scpi_device_t * device) {
+    if (device == NULL) {
+        return;
+    }
+    delete[] device->cmdlist;
+    delete[] device->handlers;
+    delete device;
+}
+
+/**
+ * Set *IDN? response fields, strings have to stay valid
+ * @param device
+ * @param manufacturer
+ * @param model
+ * @param serial
+ * @param version
+ */
+void scpi_device_idn(scpi_device_t * device, const char * manufacturer, const char * model, const char * serial, const char * version) {
+    device->instrument.idn[0] = manufacturer;
+    device->instrument.idn[1] = model;
+    device->instrument.idn[2] = serial;
+    device->instrument.idn[3] = version;
+}
+
+void * scpi_device_context(scpi_device_t * device) {
+    return device->user_context;
+}
+
+/**
+ * Create session of the device
+ * @param device
+ * @param user_context
+ * @return session or NULL if out of memory
+ */
+scpi_session_t * scpi_session_new(scpi_device_t * device, void * user_context) {
+    scpi_session_t * session = new (std::nothrow) scpi_session_t(device, user_context);
+
+    if (session != NULL) {
+        session->SCPI_Init();
+    }
+    return session;
+}
+
+void scpi_session_free(scpi_session_t * session) {
+    delete session;
+}
+
+scpi_device_t * scpi_session_device(scpi_session_t * session) {
+    return session->device;
+}
+
+void * scpi_session_context(scpi_session_t * session) {
+    return session->user_context;
+}
+
+int scpi_input(scpi_session_t * session, const char * data, size_t len) {
+    return session->SCPI_Input(data, len);
+}
+
+char * scpi_input_buffer(scpi_session_t * session, size_t * len) {
+    return session->SCPI_InputBuffer(len);
+}
+
+int scpi_input_commit(scpi_session_t * session, size_t len) {
+    return session->SCPI_InputCommit(len);
+}
+
+int scpi_input_end(scpi_session_t * session) {
+    return session->SCPI_InputEnd();
+}
+
+void scpi_device_clear(scpi_session_t * session) {
+    session->SCPI_DeviceClear();
+}
+
+void scpi_response_terminator(scpi_session_t * session, const char * terminator) {
+    session->SCPI_ResponseTerminator(terminator);
+}
+
+size_t scpi_output_peek(scpi_session_t * session, const char ** data) {
+    return session->SCPI_OutputPeek(data);
+}
+
+void scpi_output_consume(scpi_session_t * session, size_t len) {
+    session->SCPI_OutputConsume(len);
+}
+
+size_t scpi_output_read(scpi_session_t * session, char * data, size_t len) {
+    return session->SCPI_OutputRead(data, len);
+}
+
+int scpi_param_int(scpi_session_t * session, int32_t * value, int mandatory) {
+    return session->SCPI_ParamInt(value, mandatory != 0);
+}
+
+#if !SCPI_USE_FIXED_POINT
+int scpi_param_double(scpi_session_t * session, double * value, int mandatory) {
+    return session->SCPI_ParamDouble(value, mandatory != 0);
+}
+#endif
+
+int scpi_param_decimal(scpi_session_t * session, int64_t * mantissa, int16_t * exponent, int mandatory) {
+    scpi_decimal_t value;
+    SCPICore::scpi_bool_t result = session->SCPI_ParamDecimal(&value, mandatory != 0);
+
+    if (result) {
+        *mantissa = value.mantissa;
+        *exponent = value.exponent;
+    }
+    return result;
+}
+
+int scpi_param_bool(scpi_session_t * session, int * value, int mandatory) {
+    SCPICore::scpi_bool_t flag = FALSE;
+    SCPICore::scpi_bool_t result = session->SCPI_ParamBool(&flag, mandatory != 0);
+
+    if (result) {
+        *value = flag;
+    }
+    return result;
+}
+
+int scpi_param_string(scpi_session_t * session, const char ** value, size_t * len, int mandatory) {
+    return session->SCPI_ParamString(value, len, mandatory != 0);
+}
+
+int scpi_param_text(scpi_session_t * session, const char ** value, size_t * len, int mandatory) {
+    return session->SCPI_ParamText(value, len, mandatory != 0);
+}
+
+int scpi_param_choice(scpi_session_t * session, const char * options[], int32_t * value, int mandatory) {
+    return session->SCPI_ParamChoice(options, value, mandatory != 0);
+}
+
+size_t scpi_result_int(scpi_session_t * session, int32_t value) {
+    return session->SCPI_ResultInt(value);
+}
+
+#if !SCPI_USE_FIXED_POINT
+size_t scpi_result_double(scpi_session_t * session, double value) {
+    return session->SCPI_ResultDouble(value);
+}
+#endif
+
+size_t scpi_result_decimal(scpi_session_t * session, int64_t mantissa, int16_t exponent) {
+    scpi_decimal_t value;
+
+    value.mantissa = mantissa;
+    value.exponent = exponent;
+    return session->SCPI_ResultDecimal(value);
+}
+
+size_t scpi_result_bool(scpi_session_t * session, int value) {
+    return session->SCPI_ResultBool(value != 0);
+}
+
+size_t scpi_result_string(scpi_session_t * session, const char * data) {
+    return session->SCPI_ResultString(data);
+}
+
+size_t scpi_result_text(scpi_session_t * session, const char * data) {
+    return session->SCPI_ResultText(data);
+}
+
+size_t scpi_result_block(scpi_session_t * session, const char * data, size_t len) {
+    return session->SCPI_ResultArbitraryBlock(data, len);
+}
+
+void scpi_error_push(scpi_session_t * session, int16_t code) {
+    session->SCPI_ErrorPush(code);
+}
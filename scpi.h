@@ -0,0 +1,92 @@
+/**
+ * @file   scpi.h
+ *
+ * @brief  C interface of the parser
+ *
+ * Instrument (scpi_device_t) is defined once by its command table and
+ * shared by its sessions, every session is one connection or port. The
+ * transport passes received data by scpi_input (or by scpi_input_buffer
+ * and scpi_input_commit without a copy) and sends what scpi_output_peek
+ * returns. Command handlers read parameters and write results through the
+ * session they get.
+ *
+ * Sessions start with the IEEE 488.2 common commands and SYSTem:ERRor,
+ * commands of the device table with the same pattern take precedence.
+ */
+
+#ifndef SCPI_H
+#define SCPI_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* results of command handlers, same values as scpi_result_t */
+#define SCPI_OK 1
+#define SCPI_ERROR -1
+
+typedef struct scpi_device scpi_device_t;
+typedef struct scpi_session scpi_session_t;
+
+typedef int (*scpi_handler_t)(scpi_session_t * session);
+
+typedef struct scpi_handler_def {
+    const char * pattern;
+    scpi_handler_t handler;
+} scpi_handler_def_t;
+
+#define SCPI_HANDLERS_END {NULL, NULL}
+
+scpi_device_t * scpi_device_new(const scpi_handler_def_t * handlers, void * user_context);
+void scpi_device_free(scpi_device_t * device);
+void scpi_device_idn(scpi_device_t * device, const char * manufacturer, const char * model, const char * serial, const char * version);
+void * scpi_device_context(scpi_device_t * device);
+
+scpi_session_t * scpi_session_new(scpi_device_t * device, void * user_context);
+void scpi_session_free(scpi_session_t * session);
+scpi_device_t * scpi_session_device(scpi_session_t * session);
+void * scpi_session_context(scpi_session_t * session);
+
+int scpi_input(scpi_session_t * session, const char * data, size_t len);
+char * scpi_input_buffer(scpi_session_t * session, size_t * len);
+int scpi_input_commit(scpi_session_t * session, size_t len);
+int scpi_input_end(scpi_session_t * session);
+void scpi_device_clear(scpi_session_t * session);
+void scpi_response_terminator(scpi_session_t * session, const char * terminator);
+
+size_t scpi_output_peek(scpi_session_t * session, const char ** data);
+void scpi_output_consume(scpi_session_t * session, size_t len);
+size_t scpi_output_read(scpi_session_t * session, char * data, size_t len);
+
+int scpi_param_int(scpi_session_t * session, int32_t * value, int mandatory);
+#if !SCPI_USE_FIXED_POINT
+int scpi_param_double(scpi_session_t * session, double * value, int mandatory);
+#endif
+int scpi_param_decimal(scpi_session_t * session, int64_t * mantissa, int16_t * exponent, int mandatory);
+int scpi_param_bool(scpi_session_t * session, int * value, int mandatory);
+int scpi_param_string(scpi_session_t * session, const char ** value, size_t * len, int mandatory);
+int scpi_param_text(scpi_session_t * session, const char ** value, size_t * len, int mandatory);
+int scpi_param_choice(scpi_session_t * session, const char * options[], int32_t * value, int mandatory);
+
+size_t scpi_result_int(scpi_session_t * session, int32_t value);
+#if !SCPI_USE_FIXED_POINT
+size_t scpi_result_double(scpi_session_t * session, double value);
+#endif
+size_t scpi_result_decimal(scpi_session_t * session, int64_t mantissa, int16_t exponent);
+size_t scpi_result_bool(scpi_session_t * session, int value);
+size_t scpi_result_string(scpi_session_t * session, const char * data);
+size_t scpi_result_text(scpi_session_t * session, const char * data);
+size_t scpi_result_block(scpi_session_t * session, const char * data, size_t len);
+
+void scpi_error_push(scpi_session_t * session, int16_t code);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SCPI_H
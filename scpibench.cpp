@@ -0,0 +1,439 @@
+/**
+ * @file   scpibench.cpp
+ *
+ * @brief  Benchmarks of the parser core
+ *
+ * Usage: scpi-bench pool [sessions] [commands]
+ *        scpi-bench registers [updates]
+ *        scpi-bench sessions [count]
+ *
+ * pool - sessions send queries to the worker pool, run with 1 to number of
+ *        cores workers; responses are checked to come in order per session
+ * registers - time of one status register write propagated to STB, compared
+ *             with the former register model
+ * sessions - footprint and creation time of sessions of a server, the
+ *            session allocates nothing besides the object until it is
+ *            attached to a pool
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <thread>
+
+#include "scpiworkerpool.h"
+
+/* queries of one session in flight, less than the unit queue */
+#define BENCH_IN_FLIGHT 8
+
+/* iterations of work done by one query */
+#define BENCH_WORK 2000
+
+static double benchNow() {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+class BenchSession : public SCPISession
+{
+public:
+    BenchSession(const scpi_instrument_t * instrument) :
+        SCPISession(instrument),
+        value(0),
+        expected(0),
+        sent(0),
+        received(0),
+        disorder(0)
+    {
+        SCPI_Init();
+    }
+
+    /* WORK? n - simulated measurement, returns n */
+    scpi_result_t WorkQ() {
+        volatile uint32_t acc = 0;
+        int32_t n;
+        int i;
+
+        if (!SCPI_ParamInt(&n, TRUE)) {
+            return SCPI_RES_ERR;
+        }
+        for (i = 0; i < BENCH_WORK; i++) {
+            acc = acc * 31 + i;
+        }
+        SCPI_ResultInt(n);
+        return SCPI_RES_OK;
+    }
+
+    /* write of the pool, on the worker running the session */
+    static size_t poolWrite(SCPICore * session, const char * data, size_t len, void * user_context) {
+        BenchSession * bench = static_cast<BenchSession *>(session);
+        size_t i;
+
+        (void) user_context;
+        for (i = 0; i < len; i++) {
+            if (data[i] >= '0' && data[i] <= '9') {
+                bench->value = bench->value * 10 + (data[i] - '0');
+            } else if (data[i] == '\n') {
+                if (bench->value != bench->expected) {
+                    bench->disorder++;
+                }
+                bench->expected++;
+                bench->value = 0;
+                bench->received.fetch_add(1, std::memory_order_release);
+            }
+        }
+        return len;
+    }
+
+    uint32_t value;
+    uint32_t expected;
+    uint32_t sent;
+    std::atomic<uint32_t> received;
+    uint32_t disorder;
+};
+
+#define BENCH_CMD(pattern, method) {pattern, static_cast<SCPICore::scpi_command_callback_t>(&BenchSession::method),}
+
+static const SCPICore::scpi_command_t bench_commands[] = {
+    BENCH_CMD("WORK?", WorkQ),
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t bench_instrument;
+
+/**
+ * Run all queries of all sessions with given number of workers
+ * @param workers
+ * @param count - number of sessions
+ * @param commands - queries sent by every session
+ * @return seconds, negative if responses were lost or out of order
+ */
+static double benchPoolRun(int workers, int count, uint32_t commands) {
+    SCPIWorkerPool pool(workers);
+    BenchSession ** sessions = new BenchSession *[count];
+    char line[32];
+    double start;
+    double result;
+    int done;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        sessions[i] = new BenchSession(&bench_instrument);
+        sessions[i]->SCPI_PoolAttach(&pool, BenchSession::poolWrite, NULL);
+    }
+
+    start = benchNow();
+    do {
+        done = 0;
+        for (i = 0; i < count; i++) {
+            BenchSession * session = sessions[i];
+            uint32_t received = session->received.load(std::memory_order_acquire);
+
+            if (received == commands) {
+                done++;
+                continue;
+            }
+            while (session->sent < commands && session->sent - received < BENCH_IN_FLIGHT) {
+                snprintf(line, sizeof(line), "WORK? %u\n", (unsigned) session->sent);
+                if (session->SCPI_InputDispatch(line, strlen(line)) < 0) {
+                    break;
+                }
+                session->sent++;
+            }
+        }
+        if (done < count) {
+            std::this_thread::yield();
+        }
+    } while (done < count);
+    result = benchNow() - start;
+
+    for (i = 0; i < count; i++) {
+        if (sessions[i]->disorder > 0) {
+            result = -1;
+        }
+        delete sessions[i];
+    }
+    delete[] sessions;
+    return result;
+}
+
+/**
+ * Scaling of the worker pool from one worker to number of cores
+ * @param count - number of sessions
+ * @param commands - queries sent by every session
+ * @return 0 on success
+ */
+static int benchPool(int count, uint32_t commands) {
+    int cores = std::thread::hardware_concurrency();
+    double base = 0;
+    double seconds;
+    int workers;
+
+    if (cores <= 0) {
+        cores = 1;
+    }
+
+    printf("pool: %d sessions, %u queries each, %d cores\n", count, (unsigned) commands, cores);
+    printf("workers   seconds   queries/s   speedup\n");
+    for (workers = 1; workers <= cores; workers++) {
+        seconds = benchPoolRun(workers, count, commands);
+        if (seconds < 0) {
+            fprintf(stderr, "responses out of order with %d workers\n", workers);
+            return 1;
+        }
+        if (workers == 1) {
+            base = seconds;
+        }
+        printf("%7d %9.3f %11.0f %9.2f\n", workers, seconds, count * (double) commands / seconds, base / seconds);
+    }
+    return 0;
+}
+
+/*
+ * Status register model replaced by the register groups, SCPI_RegSet with
+ * propagation through switch and recursive register writes. Kept to
+ * compare both models.
+ */
+class BaselineRegisters
+{
+public:
+    BaselineRegisters() : control(NULL) {
+        memset(registers, 0, sizeof(registers));
+    }
+
+    scpi_reg_val_t get(scpi_reg_name_t name) {
+        return (name < SCPI_REG_COUNT) ? registers[name] : 0;
+    }
+
+    void set(scpi_reg_name_t name, scpi_reg_val_t val) {
+        scpi_bool_t srq = FALSE;
+        scpi_reg_val_t mask;
+        scpi_reg_val_t old_val;
+
+        if (name >= SCPI_REG_COUNT) {
+            return;
+        }
+
+        old_val = registers[name];
+        registers[name] = val;
+
+        switch (name) {
+        case SCPI_REG_STB:
+            mask = get(SCPI_REG_SRE);
+            mask &= ~STB_SRQ;
+            if (val & mask) {
+                val |= STB_SRQ;
+                if (old_val != val) {
+                    srq = TRUE;
+                }
+            } else {
+                val &= ~STB_SRQ;
+            }
+            break;
+        case SCPI_REG_SRE:
+            set(SCPI_REG_STB, get(SCPI_REG_STB));
+            break;
+        case SCPI_REG_ESR:
+            updateSTB(val, SCPI_REG_ESE, STB_ESR);
+            break;
+        case SCPI_REG_ESE:
+            set(SCPI_REG_ESR, get(SCPI_REG_ESR));
+            break;
+        case SCPI_REG_QUES:
+            updateSTB(val, SCPI_REG_QUESE, STB_QES);
+            break;
+        case SCPI_REG_QUESE:
+            set(SCPI_REG_QUES, get(SCPI_REG_QUES));
+            break;
+        case SCPI_REG_OPER:
+            updateSTB(val, SCPI_REG_OPERE, STB_OPS);
+            break;
+        case SCPI_REG_OPERE:
+            set(SCPI_REG_OPER, get(SCPI_REG_OPER));
+            break;
+        default:
+            break;
+        }
+
+        registers[name] = val;
+
+        if (srq && control != NULL) {
+            control(get(SCPI_REG_STB));
+        }
+    }
+
+    void setBits(scpi_reg_name_t name, scpi_reg_val_t bits) {
+        set(name, get(name) | bits);
+    }
+
+    void clearBits(scpi_reg_name_t name, scpi_reg_val_t bits) {
+        set(name, get(name) & ~bits);
+    }
+
+    void updateSTB(scpi_reg_val_t val, scpi_reg_name_t mask, scpi_reg_val_t stbBits) {
+        if (val & get(mask)) {
+            setBits(SCPI_REG_STB, stbBits);
+        } else {
+            clearBits(SCPI_REG_STB, stbBits);
+        }
+    }
+
+    void (* volatile control)(scpi_reg_val_t stb);
+    scpi_reg_val_t registers[SCPI_REG_COUNT];
+};
+
+/* best of repeated runs */
+#define BENCH_REPEAT 5
+
+/**
+ * Time of one register write, best of BENCH_REPEAT runs
+ * @param regs - BenchSession or BaselineRegisters
+ * @param name - register written, set and cleared in turn
+ * @param bit - toggled bit
+ * @param updates - number of writes
+ * @return ns per write
+ */
+static double benchRegisterWrites(BenchSession * session, scpi_reg_name_t name, scpi_reg_val_t bit, int updates) {
+    double best = 0;
+    double seconds;
+    int run;
+    int i;
+
+    for (run = 0; run < BENCH_REPEAT; run++) {
+        seconds = benchNow();
+        for (i = 0; i < updates; i += 2) {
+            session->SCPI_RegSetBits(name, bit);
+            session->SCPI_RegClearBits(name, bit);
+        }
+        seconds = benchNow() - seconds;
+        if (run == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best * 1e9 / updates;
+}
+
+/* former model was called from other translation unit, it is called
+ * through member pointer so it is not inlined to the loop */
+typedef void (BaselineRegisters::*bench_reg_write_t)(scpi_reg_name_t name, scpi_reg_val_t bits);
+static bench_reg_write_t volatile bench_set_bits = &BaselineRegisters::setBits;
+static bench_reg_write_t volatile bench_clear_bits = &BaselineRegisters::clearBits;
+
+static double benchRegisterWrites(BaselineRegisters * regs, scpi_reg_name_t name, scpi_reg_val_t bit, int updates) {
+    double best = 0;
+    double seconds;
+    int run;
+    int i;
+
+    for (run = 0; run < BENCH_REPEAT; run++) {
+        seconds = benchNow();
+        for (i = 0; i < updates; i += 2) {
+            (regs->*bench_set_bits)(name, bit);
+            (regs->*bench_clear_bits)(name, bit);
+        }
+        seconds = benchNow() - seconds;
+        if (run == 0 || seconds < best) {
+            best = seconds;
+        }
+    }
+    return best * 1e9 / updates;
+}
+
+/**
+ * Status register writes, every write is propagated to STB. Register
+ * groups are compared with the baseline model, which has no condition
+ * registers.
+ * @param updates - number of writes of every register
+ * @return 0 on success
+ */
+static int benchRegisters(int updates) {
+    BenchSession session(&bench_instrument);
+    BaselineRegisters baseline;
+
+    session.SCPI_RegSet(SCPI_REG_ESE, ESR_OPC);
+    session.SCPI_RegSet(SCPI_REG_OPERE, 0x0001);
+    baseline.set(SCPI_REG_ESE, ESR_OPC);
+    baseline.set(SCPI_REG_OPERE, 0x0001);
+
+    printf("registers: %d writes, best of %d runs\n", updates, BENCH_REPEAT);
+    printf("register  baseline ns/write  groups ns/write\n");
+    printf("ESR       %17.1f %16.1f\n", benchRegisterWrites(&baseline, SCPI_REG_ESR, ESR_OPC, updates),
+           benchRegisterWrites(&session, SCPI_REG_ESR, ESR_OPC, updates));
+    /* bit not enabled in ESE, STB does not change */
+    printf("ESR EER   %17.1f %16.1f\n", benchRegisterWrites(&baseline, SCPI_REG_ESR, ESR_EER, updates),
+           benchRegisterWrites(&session, SCPI_REG_ESR, ESR_EER, updates));
+    printf("OPER      %17.1f %16.1f\n", benchRegisterWrites(&baseline, SCPI_REG_OPER, 0x0001, updates),
+           benchRegisterWrites(&session, SCPI_REG_OPER, 0x0001, updates));
+    /* condition latched through transition filter, event stays set */
+    printf("OPERC     %17s %16.1f\n", "-", benchRegisterWrites(&session, SCPI_REG_OPERC, 0x0001, updates));
+    return 0;
+}
+
+/**
+ * Create and initialize count sessions of one type
+ * @param name - printed name of the session type
+ * @param count - number of sessions
+ */
+template<typename Session>
+static void benchSessionsRun(const char * name, int count) {
+    Session ** sessions = new Session *[count];
+    double start;
+    double created;
+    int i;
+
+    start = benchNow();
+    for (i = 0; i < count; i++) {
+        sessions[i] = new Session(&bench_instrument);
+        sessions[i]->SCPI_Init();
+    }
+    created = benchNow() - start;
+
+    for (i = 0; i < count; i++) {
+        delete sessions[i];
+    }
+    delete[] sessions;
+
+    printf("%-16s %8u %12.3f %10.1f\n", name, (unsigned) sizeof(Session),
+           count * (double) sizeof(Session) / (1024 * 1024), created * 1e9 / count);
+}
+
+/**
+ * Sessions of a server sharing one instrument definition
+ * @param count - number of sessions
+ * @return 0 on success
+ */
+static int benchSessions(int count) {
+    printf("sessions: %d\n", count);
+    printf("%-16s %8s %12s %10s\n", "session", "bytes", "total MiB", "ns/session");
+    benchSessionsRun<SCPISession>("default", count);
+    benchSessionsRun<SCPIBasicSession<128, 8, 128> >("<128, 8, 128>", count);
+    benchSessionsRun<SCPIBasicSession<64, 4, 64> >("<64, 4, 64>", count);
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    SCPICore::SCPI_InstrumentInit(&bench_instrument, bench_commands);
+
+    if (argc >= 2 && strcmp(argv[1], "pool") == 0) {
+        return benchPool(argc >= 3 ? atoi(argv[2]) : 1000, argc >= 4 ? atoi(argv[3]) : 100);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "registers") == 0) {
+        return benchRegisters(argc >= 3 ? atoi(argv[2]) : 4000000);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "sessions") == 0) {
+        return benchSessions(argc >= 3 ? atoi(argv[2]) : 10000);
+    }
+
+    fprintf(stderr, "usage: scpi-bench pool [sessions] [commands]\n"
+            "       scpi-bench registers [updates]\n"
+            "       scpi-bench sessions [count]\n");
+    return 2;
+}
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Benchmarks of the parser core, run scpi-bench
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-bench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += scpibench.cpp
+
+include(scpicore.pri)
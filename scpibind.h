@@ -0,0 +1,244 @@
+/**
+ * @file   scpibind.h
+ *
+ * @brief  Commands bound to handlers with typed parameters
+ *
+ * SCPI_Bind makes command table entry from a handler and the schema of its
+ * parameters:
+ *
+ *   static const char * ranges[] = {"LOW", "HIGH", NULL};
+ *   scpi_result_t setVolt(Dev & dev, scpi_real_t volt, int32_t range);
+ *
+ *   SCPI_Bind<&setVolt>("SOURce:VOLTage", SCPI_Number(SCPI_UNIT_VOLT, 0, 30, 1), SCPI_Choice(ranges)),
+ *
+ * All parameters are parsed and checked in one pass (SCPI_ParamSchema)
+ * before the handler is called, MINimum, MAXimum and DEFault resolve to the
+ * values of the schema. The command is called through plain function, not
+ * through member function pointer.
+ *
+ * Handler is a function taking the session (SCPICore or derived class) by
+ * reference, or a member function of the session class. Arguments follow
+ * the schema: SCPI_Number - scpi_real_t, SCPI_Int and SCPI_Choice -
+ * int32_t, SCPI_Bool - bool.
+ *
+ * Schema is allocated when the command table is initialized and lives as
+ * long as the program, like the table.
+ *
+ * Set/query pair on one value needs no handler at all, SCPI_SETTING
+ * generates both commands of a setting:
+ *
+ *   static scpi_setting_t volt(SCPI_Number(SCPI_UNIT_VOLT, 0, 30, 1));
+ *
+ *   SCPI_SETTING("SOURce:VOLTage", volt),
+ *
+ * "SOUR:VOLT 5" stores the value, "SOUR:VOLT?" returns it and
+ * "SOUR:VOLT? MAX" returns the limit of the schema. The device reads the
+ * value by SCPI_SettingGet from any thread without blocking the sessions.
+ *
+ * SCPI_Bind requires C++17, disable with -DSCPI_USE_BINDINGS=0. Settings
+ * work in C++11.
+ */
+
+#ifndef SCPI_BIND_H
+#define	SCPI_BIND_H
+
+#include "scpicore.h"
+
+#ifndef SCPI_USE_BINDINGS
+#if defined(__cpp_nontype_template_parameter_auto)
+#define SCPI_USE_BINDINGS 1
+#else
+#define SCPI_USE_BINDINGS 0
+#endif
+#endif
+
+/* parameter of the schema, get gives the handler argument */
+struct scpi_bind_number_t {
+    scpi_param_def_t param;
+    static scpi_real_t get(const scpi_param_value_t & value) { return value.number; }
+    operator const scpi_param_def_t &() const { return param; }
+};
+
+struct scpi_bind_int_t {
+    scpi_param_def_t param;
+    static int32_t get(const scpi_param_value_t & value) { return value.integer; }
+    operator const scpi_param_def_t &() const { return param; }
+};
+
+struct scpi_bind_bool_t {
+    scpi_param_def_t param;
+    static bool get(const scpi_param_value_t & value) { return value.flag; }
+    operator const scpi_param_def_t &() const { return param; }
+};
+
+struct scpi_bind_choice_t {
+    scpi_param_def_t param;
+    static int32_t get(const scpi_param_value_t & value) { return value.integer; }
+    operator const scpi_param_def_t &() const { return param; }
+};
+
+/**
+ * Number parameter in base unit
+ * @param unit - accepted unit, number without unit is accepted too
+ * @param min
+ * @param max
+ * @param def - value of DEFault
+ */
+inline scpi_bind_number_t SCPI_Number(scpi_unit_t unit, scpi_real_t min, scpi_real_t max, scpi_real_t def) {
+    scpi_bind_number_t result = {};
+    result.param.kind = SCPI_PARAM_NUMBER;
+    result.param.unit = unit;
+    result.param.min = min;
+    result.param.max = max;
+    result.param.def = def;
+    return result;
+}
+
+inline scpi_bind_int_t SCPI_Int(int32_t min, int32_t max, int32_t def) {
+    scpi_bind_int_t result = {};
+    result.param.kind = SCPI_PARAM_INT;
+    result.param.imin = min;
+    result.param.imax = max;
+    result.param.idef = def;
+    return result;
+}
+
+/**
+ * Boolean parameter
+ * @param def - initial value of setting
+ */
+inline scpi_bind_bool_t SCPI_Bool(bool def = false) {
+    scpi_bind_bool_t result = {};
+    result.param.kind = SCPI_PARAM_BOOL;
+    result.param.idef = def ? 1 : 0;
+    return result;
+}
+
+/**
+ * Choice parameter, handler gets index of the matched option
+ * @param options - patterns, ends by NULL, have to stay valid
+ * @param def - index of initial option of setting, first option if it is
+ *              not index of an option
+ */
+inline scpi_bind_choice_t SCPI_Choice(const char * const * options, int32_t def = 0) {
+    scpi_bind_choice_t result = {};
+    int32_t count = 0;
+
+    while (options[count] != NULL) {
+        count++;
+    }
+    result.param.kind = SCPI_PARAM_CHOICE;
+    result.param.options = options;
+    result.param.idef = (def >= 0 && def < count) ? def : 0;
+    return result;
+}
+
+/**
+ * Command storing value of setting
+ * @param pattern - command pattern
+ * @param setting
+ * @return command
+ */
+inline SCPICore::scpi_command_t SCPI_BindSetting(const char * pattern, scpi_setting_t & setting) {
+    SCPICore::scpi_command_t cmd = {};
+
+    cmd.pattern = pattern;
+    cmd.binding = &setting.set;
+    return cmd;
+}
+
+/**
+ * Command returning value of setting
+ * @param pattern - query pattern
+ * @param setting
+ * @return command
+ */
+inline SCPICore::scpi_command_t SCPI_BindQuery(const char * pattern, scpi_setting_t & setting) {
+    SCPICore::scpi_command_t cmd = {};
+
+    cmd.pattern = pattern;
+    cmd.binding = &setting.query;
+    return cmd;
+}
+
+/* both commands of setting, pattern has to be string literal */
+#define SCPI_SETTING(pattern, setting) \
+    SCPI_BindSetting(pattern, setting), SCPI_BindQuery(pattern "?", setting)
+
+#if SCPI_USE_BINDINGS
+
+#include <utility>
+
+/* calling of the handler by its type */
+template <typename F>
+struct scpi_bind_handler_t;
+
+/* function taking the session */
+template <typename S, typename... A>
+struct scpi_bind_handler_t<scpi_result_t (*)(S &, A...)> {
+    static const size_t arity = sizeof...(A);
+
+    template <auto fn, typename... V>
+    static scpi_result_t call(SCPICore * session, V... values) {
+        return fn(static_cast<S &>(*session), values...);
+    }
+};
+
+/* member function of the session class */
+template <typename S, typename... A>
+struct scpi_bind_handler_t<scpi_result_t (S::*)(A...)> {
+    static const size_t arity = sizeof...(A);
+
+    template <auto fn, typename... V>
+    static scpi_result_t call(SCPICore * session, V... values) {
+        return (static_cast<S *>(session)->*fn)(values...);
+    }
+};
+
+/* binding of one command, schema and the function parsing it for fn */
+template <auto fn, typename... P>
+struct scpi_bound_t : scpi_binding_t {
+    scpi_param_def_t schema[sizeof...(P) + 1];
+
+    scpi_bound_t(const P &... params) : schema{params.param...} {
+        invoke = run;
+        this->params = schema;
+        count = sizeof...(P);
+        target = NULL;
+    }
+
+    static scpi_result_t run(SCPICore * session, const scpi_binding_t * binding) {
+        return runIndexed(session, binding, std::index_sequence_for<P...>());
+    }
+
+    template <size_t... I>
+    static scpi_result_t runIndexed(SCPICore * session, const scpi_binding_t * binding, std::index_sequence<I...>) {
+        scpi_param_value_t values[sizeof...(P) + 1];
+
+        if (!session->SCPI_ParamSchema(binding->params, binding->count, values)) {
+            return SCPI_RES_ERR;
+        }
+        return scpi_bind_handler_t<decltype(fn)>::template call<fn>(session, P::get(values[I])...);
+    }
+};
+
+/**
+ * Command table entry calling fn with parameters parsed by the schema
+ * @param pattern - command pattern
+ * @param params - SCPI_Number, SCPI_Int, SCPI_Bool or SCPI_Choice for every
+ *                 argument of fn after the session
+ * @return command
+ */
+template <auto fn, typename... P>
+SCPICore::scpi_command_t SCPI_Bind(const char * pattern, const P &... params) {
+    SCPICore::scpi_command_t cmd = {};
+
+    static_assert(scpi_bind_handler_t<decltype(fn)>::arity == sizeof...(P), "handler arguments do not match the schema");
+    cmd.pattern = pattern;
+    cmd.binding = new scpi_bound_t<fn, P...>(params...);
+    return cmd;
+}
+
+#endif /* SCPI_USE_BINDINGS */
+
+#endif	/* SCPI_BIND_H */
@@ -0,0 +1,4379 @@
+/* standard library headers go before min/max of utils */
+#include <chrono>
+#include "scpiworkerpool.h"
+#include "scpicore.h"
+
+#if defined(__unix__)
+#include <unistd.h>
+#endif
+
+/**
+ * Session over storage of SCPIBasicSession
+ * @param instrument - shared instrument definition, NULL for default one
+ * @param input - input buffer
+ * @param input_len
+ * @param errors - error queue slots
+ * @param errors_len - number of slots, power of two
+ * @param output - output queue
+ * @param output_len
+ */
+SCPICore::SCPICore(const scpi_instrument_t * instrument, char * input, size_t input_len, _fifo_slot_t * errors, size_t errors_len, char * output, size_t output_len)
+{
+    context.buffer.data = input;
+    context.buffer.length = input_len;
+    context.output.data = output;
+    context.output.length = output_len;
+    local_error_queue.data = errors;
+    local_error_queue.mask = errors_len - 1;
+    init(instrument);
+}
+
+/**
+ * Initialize session state
+ * @param instrument - shared instrument definition, NULL for default one
+ */
+void SCPICore::init(const scpi_instrument_t * instrument) {
+    int i;
+
+    context.instrument = (instrument != NULL) ? instrument : SCPI_InstrumentDefault();
+
+    memset(&scpi_status, 0, sizeof(scpi_status));
+    scpi_status.clock = statusClock;
+    scpi_operations.pending = 0;
+    scpi_operations.done.store(0, std::memory_order_relaxed);
+    scpi_operations.opc = FALSE;
+    scpi_operations.opcq = FALSE;
+    scpi_operations.wai = FALSE;
+    scpi_operations.coroutine = NULL;
+    scpi_operations.resume.store(false, std::memory_order_relaxed);
+    scpi_operations.executor = NULL;
+    scpi_operations.queued.store(false, std::memory_order_relaxed);
+    scpi_operations.next = NULL;
+    scpi_units = NULL;
+    scpi_ingress = NULL;
+
+    for (i = 0; i < SCPI_STATUS_SUBSCRIBERS; i++) {
+        scpi_status.subscribers[i].fd = -1;
+    }
+}
+
+SCPICore::~SCPICore()
+{
+#if SCPI_USE_COROUTINES
+    /* events awaited by the coroutine must not be set anymore */
+    if (scpi_operations.coroutine != NULL) {
+        std::coroutine_handle<scpi_task_t::promise_type>::from_address(scpi_operations.coroutine).destroy();
+    }
+#endif
+    free(context.output.spill);
+    /* session must not be scheduled in the pool anymore */
+    delete scpi_units;
+    /* producers must not push anymore */
+    delete scpi_ingress;
+}
+
+
+/**
+ * Find command termination character
+ * @param cmd - input command
+ * @param len - max search length
+ * @return position of terminator or len
+ */
+size_t SCPICore::cmdTerminatorPos(const char * cmd, size_t len) {
+    const char * terminator = strnpbrk(cmd, len, "; \r\n\t");
+    if (terminator == NULL) {
+        return len;
+    } else {
+        return terminator - cmd;
+    }
+}
+
+/**
+ * Find command line separator
+ * @param cmd - input command
+ * @param len - max search length
+ * @return pointer to line separator or NULL
+ */
+const char * SCPICore::cmdlineSeparator(const char * cmd, size_t len) {
+    return strnpbrk(cmd, len, ";\r\n");
+}
+
+/**
+ * Find command line terminator
+ * @param cmd - input command
+ * @param len - max search length
+ * @return pointer to command line terminator or NULL
+ */
+const char * SCPICore::cmdlineTerminator(const char * cmd, size_t len) {
+    return strnpbrk(cmd, len, "\r\n");
+}
+
+/**
+ * Find command line separator position
+ * @param cmd - input command
+ * @param len - max search length
+ * @return position of line separator or len
+ */
+size_t SCPICore::cmdlineSeparatorPos(const char * cmd, size_t len) {
+    const char * separator = cmdlineSeparator(cmd, len);
+    if (separator == NULL) {
+        return len;
+    } else {
+        return separator - cmd;
+    }
+}
+
+/**
+ * Find next part of command
+ * @param cmd - input command
+ * @param len - max search length
+ * @return number of characters to be skipped
+ */
+size_t SCPICore::skipCmdLine(const char * cmd, size_t len) {
+    const char * separator = cmdlineSeparator(cmd, len);
+    if (separator == NULL) {
+        return len;
+    } else {
+        return separator + 1 - cmd;
+    }
+}
+
+/**
+ * Write data to SCPI output
+ * @param context
+ * @param data
+ * @param len - lenght of data to be written
+ * @return number of bytes written
+ */
+size_t SCPICore::writeData( const char * data, size_t len) {
+    if (context.output.data != NULL) {
+        return outputWrite(data, len);
+    }
+    if (scpi_units != NULL && scpi_units->write != NULL) {
+        return scpi_units->write(this, data, len, scpi_units->user_context);
+    }
+    return SCPI_Write(data, len);
+    //return context.*(interface)->write(data, len);
+}
+
+/**
+ * Write several buffers to SCPI output at once. Buffered output and
+ * pooled sessions write each of them, unbuffered output hands them over
+ * to writev of the interface without being joined, if it provides one.
+ * @param iov - array of buffers
+ * @param iovcnt - number of buffers in iov
+ * @return number of bytes written
+ */
+size_t SCPICore::writeDataVector(const scpi_iovec_t * iov, size_t iovcnt) {
+    size_t result = 0;
+    size_t i;
+
+    if (context.output.data == NULL && (scpi_units == NULL || scpi_units->write == NULL)
+            && context.instrument->interface && context.instrument->interface->writev) {
+        return SCPI_WriteVector(iov, iovcnt);
+        //return context.interface->writev(iov, iovcnt);
+    }
+
+    for (i = 0; i < iovcnt; i++) {
+        result += writeData(iov[i].base, iov[i].len);
+    }
+    return result;
+}
+
+/**
+ * Flush data to SCPI output
+ * @param context
+ * @return
+ */
+int SCPICore::flushData() {
+    if (context.instrument->interface && context.instrument->interface->flush) {
+        return SCPI_Flush();
+        //return context.interface->flush(context);
+    } else {
+        return SCPI_RES_OK;
+    }
+}
+
+/**
+ * Write result delimiter to output
+ * @param context
+ * @return number of bytes written
+ */
+size_t SCPICore::writeDelimiter() {
+    if (context.output_count > 0) {
+        return writeData(", ", 2);
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * Conditionaly write "New Line"
+ * @param context
+ * @return number of characters written
+ */
+size_t SCPICore::writeNewLine() {
+    if (context.output_count > 0) {
+        size_t len;
+        len = writeData(context.output.terminator, context.output.terminator_len);
+        flushData();
+        return len;
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * Process command
+ * @param context
+ */
+void SCPICore::processCommand() {
+    const scpi_command_t * cmd = context.paramlist.cmd;
+    scpi_result_t result = SCPI_RES_OK;
+
+    context.cmd_error = FALSE;
+    context.output_count = 0;
+    context.input_count = 0;
+    context.output.message = 0;
+    context.output.overflow = FALSE;
+
+    SCPI_DEBUG_COMMAND(context);
+    /* if callback exists - call command callback */
+    if (cmd->callback != NULL) {
+        result = (this->*(cmd->callback))();
+    }
+    /* bound command, plain function parses parameters and calls the handler */
+    else if (cmd->binding != NULL) {
+        result = cmd->binding->invoke(this, cmd->binding);
+    }
+#if SCPI_USE_COROUTINES
+    else if (cmd->coroutine != NULL) {
+        scpi_task_t task = (this->*(cmd->coroutine))();
+        if (!task.handle.done()) {
+            /* command is finished by coroutineResume */
+            scpi_operations.coroutine = task.handle.address();
+            return;
+        }
+        result = task.handle.promise().result;
+        task.handle.destroy();
+    }
+#endif
+
+    commandFinish(result);
+}
+
+/**
+ * Finish processed command, check result and unread parameters
+ * @param result - result of command callback
+ */
+void SCPICore::commandFinish(scpi_result_t result) {
+    /* overlapped command continues in background */
+    if ((result != SCPI_RES_OK) && (result != SCPI_RES_PENDING) && !context.cmd_error) {
+        SCPI_ErrorPush(SCPI_ERROR_EXECUTION_ERROR);
+    }
+
+    /* conditionaly write new line, streamed result is terminated
+     * when its stream ends and *OPC? when operations complete */
+    if (context.stream.producer == NULL && !scpi_operations.opcq) {
+        writeNewLine();
+    }
+
+    /* skip all whitespaces */
+    paramSkipWhitespace();
+
+    /* set error if command callback did not read all parameters */
+    if (context.paramlist.length != 0 && !context.cmd_error) {
+        SCPI_ErrorPush(SCPI_ERROR_PARAMETER_NOT_ALLOWED);
+    }
+}
+
+/**
+ * Cycle all patterns and search matching pattern. Execute command callback.
+ * @param context
+ * @result TRUE if context.paramlist is filled with correct values
+ */
+scpi_bool_t SCPICore::findCommand(const char * cmdline_ptr, size_t cmdline_len, size_t cmd_len) {
+    const scpi_command_t * cmd = lookupCommand(cmdline_ptr, cmd_len);
+
+    if (cmd == NULL) {
+        return FALSE;
+    }
+
+    context.paramlist.cmd = cmd;
+    context.paramlist.parameters = cmdline_ptr + cmd_len;
+    context.paramlist.length = cmdline_len - cmd_len;
+    return TRUE;
+}
+
+/**
+ * Search command matching the header in the command index
+ * @param header - command header
+ * @param len - length of header
+ * @return first matching command in cmdlist order or NULL
+ */
+const SCPICore::scpi_command_t * SCPICore::lookupCommand(const char * header, size_t len) {
+    int32_t i;
+    const scpi_command_t * cmd = NULL;
+    const scpi_instrument_t * instrument = context.instrument;
+    const uint16_t * any;
+    const uint16_t * any_end;
+    const uint16_t * bucket;
+    const uint16_t * bucket_end;
+    int b;
+
+    if (instrument->indexed) {
+        /* merge bucket of the header with patterns that can start with
+         * anything, so the first match in cmdlist order wins */
+        b = indexBucket(header, len);
+        any = &instrument->index[instrument->bucket[0]];
+        any_end = &instrument->index[instrument->bucket[1]];
+        bucket = &instrument->index[instrument->bucket[b]];
+        bucket_end = (b == 0) ? bucket : &instrument->index[instrument->bucket[b + 1]];
+
+        while (any < any_end || bucket < bucket_end) {
+            if (bucket == bucket_end || (any < any_end && *any < *bucket)) {
+                i = *any++;
+            } else {
+                i = *bucket++;
+            }
+            if (matchCommand(instrument->cmdlist[i].pattern, header, len)) {
+                cmd = &instrument->cmdlist[i];
+                break;
+            }
+        }
+    } else {
+        for (i = 0; instrument->cmdlist[i].pattern != NULL; i++) {
+            if (matchCommand(instrument->cmdlist[i].pattern, header, len)) {
+                cmd = &instrument->cmdlist[i];
+                break;
+            }
+        }
+    }
+
+    return cmd;
+}
+
+/**
+ * Get command index bucket of a pattern or a header
+ * @param header - pattern or command header
+ * @param len - length of header
+ * @return 1 for common commands, 2 to 27 for letters 'A' to 'Z', 0 otherwise
+ */
+int SCPICore::indexBucket(const char * header, size_t len) {
+    if (len > 0 && header[0] == ':') {
+        header++;
+        len--;
+    }
+    if (len == 0) {
+        return 0;
+    }
+    if (header[0] == '*') {
+        return 1;
+    }
+    if (isalpha((unsigned char) header[0])) {
+        return 2 + (toupper((unsigned char) header[0]) - 'A');
+    }
+    return 0;
+}
+
+/**
+ * Set up instrument definition with default units, special numbers,
+ * status registers and errors and build the command index
+ * @param instrument - instrument definition
+ * @param cmdlist - commands terminated by SCPI_CMD_LIST_END, NULL for
+ * default commands
+ */
+void SCPICore::SCPI_InstrumentInit(scpi_instrument_t * instrument, const scpi_command_t * cmdlist) {
+    uint16_t count[SCPI_INDEX_BUCKETS];
+    size_t n;
+    size_t i;
+    int b;
+
+    memset(instrument, 0, sizeof(*instrument));
+    instrument->cmdlist = (cmdlist != NULL) ? cmdlist : scpi_commands;
+    instrument->interface = &scpi_interface;
+    instrument->units = scpi_units_def;
+    instrument->special_numbers = scpi_special_numbers_def;
+    SCPI_InstrumentRegGroups(instrument, scpi_reg_groups);
+    instrument->idn[0] = "MANUFACTURE";
+    instrument->idn[1] = "INSTR2013";
+    instrument->idn[2] = SCPI_DEFAULT_3;
+    instrument->idn[3] = "01-02";
+
+#define X(def, val, str) SCPI_ErrorRegister(instrument, def, str);
+    LIST_OF_ERRORS
+    LIST_OF_USER_ERRORS
+#undef X
+
+    for (n = 0; instrument->cmdlist[n].pattern != NULL; n++) {
+    }
+    if (n > SCPI_INDEX_SIZE) {
+        instrument->indexed = FALSE;
+        return;
+    }
+
+    /* counting sort keeps cmdlist order inside buckets */
+    memset(count, 0, sizeof(count));
+    for (i = 0; i < n; i++) {
+        const char * pattern = instrument->cmdlist[i].pattern;
+        count[indexBucket(pattern, strlen(pattern))]++;
+    }
+    instrument->bucket[0] = 0;
+    for (b = 0; b < SCPI_INDEX_BUCKETS; b++) {
+        instrument->bucket[b + 1] = instrument->bucket[b] + count[b];
+        count[b] = instrument->bucket[b];
+    }
+    for (i = 0; i < n; i++) {
+        const char * pattern = instrument->cmdlist[i].pattern;
+        b = indexBucket(pattern, strlen(pattern));
+        instrument->index[count[b]++] = i;
+    }
+    instrument->indexed = TRUE;
+}
+
+/**
+ * Set status register groups of the instrument and index them by register
+ * @param instrument - instrument definition
+ * @param reg_groups - groups terminated by SCPI_REG_GROUPS_LIST_END, at
+ * most SCPI_REG_GROUP_NONE groups are used
+ */
+void SCPICore::SCPI_InstrumentRegGroups(scpi_instrument_t * instrument, const scpi_reg_group_t * reg_groups) {
+    const scpi_reg_group_t * group;
+    int i;
+
+    instrument->reg_groups = reg_groups;
+    memset(instrument->reg_group, SCPI_REG_GROUP_NONE, sizeof(instrument->reg_group));
+    for (group = reg_groups, i = 0; group->event != SCPI_REG_COUNT && i < SCPI_REG_GROUP_NONE; group++, i++) {
+        instrument->reg_group[group->event] = i;
+        if (group->enable != SCPI_REG_COUNT) {
+            instrument->reg_group[group->enable] = i;
+        }
+        if (group->condition != SCPI_REG_COUNT) {
+            instrument->reg_group[group->condition] = i;
+        }
+    }
+}
+
+/**
+ * Instrument definition with default commands, shared by sessions
+ * created without own definition
+ * @return default instrument definition
+ */
+const SCPICore::scpi_instrument_t * SCPICore::SCPI_InstrumentDefault() {
+    static scpi_instrument_t instrument;
+    static bool initialized = (SCPI_InstrumentInit(&instrument, NULL), true);
+
+    (void) initialized;
+    return &instrument;
+}
+
+/**
+ * Parse one command line
+ * @param context
+ * @param data - complete command line
+ * @param len - command line length
+ * @return 1 if the last evaluated command was found
+ */
+int SCPICore::SCPI_Parse(char * data, size_t len) {
+    context.parse.prev = NULL;
+    context.parse.prev_len = 0;
+    return parseCommands(data, data + len);
+}
+
+/**
+ * Parse commands of one command line. If input gets blocked by a command,
+ * parsing stops and the position is stored in context.parse so it can be
+ * resumed later with the same compound command prefix.
+ * @param cmdline_ptr - first command to parse
+ * @param cmdline_end - end of command line
+ * @return 1 if the last evaluated command was found
+ */
+int SCPICore::parseCommands(char * cmdline_ptr, const char * cmdline_end) {
+    int result = 0;
+    size_t cmd_len;
+    size_t cmdline_len;
+    char * cmdline_ptr_prev = context.parse.prev;
+    size_t cmd_len_prev = context.parse.prev_len;
+
+    context.parse.rest = NULL;
+
+    while (cmdline_ptr < cmdline_end) {
+        result = 0;
+        cmd_len = cmdTerminatorPos(cmdline_ptr, cmdline_end - cmdline_ptr);
+        if (cmd_len > 0) {
+            composeCompoundCommand(cmdline_ptr_prev, cmd_len_prev,
+                                   &cmdline_ptr, &cmd_len);
+            cmdline_len = cmdlineSeparatorPos(cmdline_ptr, cmdline_end - cmdline_ptr);
+            if(findCommand(cmdline_ptr, cmdline_len, cmd_len)) {
+                processCommand();
+                result = 1;
+                cmdline_ptr_prev = cmdline_ptr;
+                cmd_len_prev = cmd_len;
+            } else {
+                SCPI_ErrorPush(SCPI_ERROR_UNDEFINED_HEADER);
+            }
+        }
+        cmdline_ptr += skipCmdLine(cmdline_ptr, cmdline_end - cmdline_ptr);
+        cmdline_ptr += skipWhitespace(cmdline_ptr, cmdline_end - cmdline_ptr);
+
+        /* finished line is kept only for suspended coroutine, which can
+         * still use its parameters */
+        if (inputBlocked() && ((cmdline_ptr < cmdline_end) || (scpi_operations.coroutine != NULL))) {
+            context.parse.rest = cmdline_ptr;
+            context.parse.end = (char *) cmdline_end;
+            context.parse.prev = cmdline_ptr_prev;
+            context.parse.prev_len = cmd_len_prev;
+            break;
+        }
+    }
+    return result;
+}
+
+/**
+ * Initialize SCPI context structure
+ * @param context
+ * @param command_list
+ * @param buffer
+ * @param interface
+ */
+void SCPICore::SCPI_Init() {
+    context.buffer.position = 0;
+    context.buffer.scan = 0;
+    context.buffer.overrun = FALSE;
+    SCPI_ErrorInit();
+    SCPI_RegInit();
+}
+
+/**
+ * Interface to the application. Adds data to system buffer and try to search
+ * command line termination. If the termination is found or if len=0, command
+ * parser is called.
+ *
+ * @param context
+ * @param data - data to process
+ * @param len - length of data
+ * @return
+ */
+int SCPICore::SCPI_Input(const char * data, size_t len) {
+    int result = 0;
+
+    SCPI_RegSync();
+    SCPI_OperationSync();
+
+    if (len == 0) {
+        if (inputBlocked() || context.parse.rest != NULL) {
+            return 0;
+        }
+        inputTerminate();
+        result = SCPI_Parse(context.buffer.data, context.buffer.position);
+        inputShift(context.buffer.position);
+    } else {
+        size_t buffer_free;
+        buffer_free = context.buffer.length - context.buffer.position;
+        if (len > (buffer_free - 1)) {
+            return -1;
+        }
+        memcpy(&context.buffer.data[context.buffer.position], data, len);
+        context.buffer.position += len;
+        inputTerminate();
+
+        result = inputProcess();
+    }
+
+    return result;
+}
+
+/**
+ * Get free part of input buffer. Transport can receive data directly to it
+ * and pass them by SCPI_InputCommit, without copying by SCPI_Input. If the
+ * buffer is full of command line without terminator, the line is discarded
+ * and Input buffer overrun is reported.
+ * @param len - number of bytes available
+ * @return first free byte of input buffer
+ */
+char * SCPICore::SCPI_InputBuffer(size_t * len) {
+    inputOverrun();
+    *len = context.buffer.length - context.buffer.position - 1;
+    return context.buffer.data + context.buffer.position;
+}
+
+/**
+ * Process data received to the buffer returned by SCPI_InputBuffer
+ * @param len - number of received bytes
+ * @return result of inputProcess or number of queued units if a pool is
+ * attached
+ */
+int SCPICore::SCPI_InputCommit(size_t len) {
+    size_t buffer_free = context.buffer.length - context.buffer.position - 1;
+
+    context.buffer.position += (len < buffer_free) ? len : buffer_free;
+    inputTerminate();
+    if (context.buffer.overrun) {
+        inputDiscard();
+    }
+
+    if (scpi_units != NULL) {
+        return dispatchProcess();
+    }
+
+    SCPI_RegSync();
+    SCPI_OperationSync();
+    return inputProcess();
+}
+
+/**
+ * Check if the session only waits for more input. Input buffer and output
+ * queue are then not changed until more data are committed, so transport
+ * can receive to the input buffer while it sends the last response.
+ * @return TRUE if there is no complete command line, no streamed result
+ * and no waiting command
+ */
+scpi_bool_t SCPICore::SCPI_InputIdle() {
+    if (context.stream.producer != NULL || context.parse.rest != NULL) {
+        return FALSE;
+    }
+    if (scpi_operations.coroutine != NULL || scpi_operations.wai || scpi_operations.opcq) {
+        return FALSE;
+    }
+    return (inputTerminator(skipWhitespace(context.buffer.data, context.buffer.position)) == NULL) ? TRUE : FALSE;
+}
+
+/**
+ * End of program message signalled by the transport (HiSLIP DataEND,
+ * GPIB EOI), last command line does not need its own terminator.
+ * @return result of inputProcess or number of queued units if a pool is
+ * attached, -1 if there is no room for the terminator
+ */
+int SCPICore::SCPI_InputEnd() {
+    size_t pos = context.buffer.position;
+
+    if (context.buffer.overrun) {
+        /* message end terminates discarded line too */
+        context.buffer.overrun = FALSE;
+    } else if ((pos > 0) && (context.buffer.data[pos - 1] != '\n') && (context.buffer.data[pos - 1] != '\r')) {
+        if (pos >= context.buffer.length - 1) {
+            if (!inputOverrun()) {
+                return -1;
+            }
+            context.buffer.overrun = FALSE;
+        } else {
+            context.buffer.data[pos] = '\n';
+            context.buffer.position = pos + 1;
+            inputTerminate();
+        }
+    }
+
+    if (scpi_units != NULL) {
+        return dispatchProcess();
+    }
+
+    SCPI_RegSync();
+    SCPI_OperationSync();
+    return inputProcess();
+}
+
+/**
+ * Device clear (IEEE 488.2 DCAS). Input buffer and output queue are
+ * cleared, waiting *WAI and *OPC?, streamed result and *OPC are canceled.
+ * Status registers and running operations are not changed, units already
+ * queued to a pool are still executed.
+ */
+void SCPICore::SCPI_DeviceClear() {
+#if SCPI_USE_COROUTINES
+    if (scpi_operations.coroutine != NULL) {
+        std::coroutine_handle<scpi_task_t::promise_type>::from_address(scpi_operations.coroutine).destroy();
+        scpi_operations.coroutine = NULL;
+    }
+#endif
+    scpi_operations.resume.store(false, std::memory_order_relaxed);
+    scpi_operations.wai = FALSE;
+    scpi_operations.opcq = FALSE;
+    scpi_operations.opc = FALSE;
+
+    context.stream.producer = NULL;
+    context.stream.user_context = NULL;
+
+    context.parse.rest = NULL;
+    context.parse.prev = NULL;
+    context.parse.prev_len = 0;
+    context.buffer.overrun = FALSE;
+    inputShift(context.buffer.position);
+
+    context.output.overflow = FALSE;
+    SCPI_OutputClear();
+}
+
+/**
+ * Receive input directly in ring shared with the writer. The ring has to
+ * be mapped twice back to back (size bytes followed by their mirror), so
+ * command lines are parsed in place even if they wrap. Writer appends
+ * behind the window, received bytes are passed by SCPI_InputCommit and
+ * processed bytes are released by moving the window. SCPI_Input,
+ * SCPI_InputDispatch, SCPI_InputEnd and ingress ring write to the buffer,
+ * they must not be used then.
+ * @param ring - first mapping of the ring
+ * @param size - size of the ring
+ */
+void SCPICore::SCPI_InputAttach(char * ring, size_t size) {
+    context.buffer.ring = ring;
+    context.buffer.data = ring;
+    context.buffer.length = size;
+    context.buffer.position = 0;
+    context.buffer.scan = 0;
+    context.buffer.overrun = FALSE;
+}
+
+/**
+ * Parse all complete command lines from input buffer. Stops if input
+ * gets blocked, rest of the buffer stays for later processing.
+ * @return 1 if the last evaluated command was found
+ */
+int SCPICore::inputProcess() {
+    int result = 0;
+    const char * cmd_term;
+    int ws;
+
+    /* units are executed by the pool */
+    if (scpi_units != NULL) {
+        return 0;
+    }
+
+    if (inputBlocked()) {
+        return 0;
+    }
+
+    /* finish command line suspended before */
+    if (context.parse.rest != NULL) {
+        result = parseCommands(context.parse.rest, context.parse.end);
+        if (context.parse.rest != NULL) {
+            return result;
+        }
+        inputShift(context.parse.end - context.buffer.data);
+    }
+
+    if (scpi_ingress != NULL) {
+        ingressMove();
+    }
+
+    ws = skipWhitespace(context.buffer.data, context.buffer.position);
+    cmd_term = inputTerminator(ws);
+    while (cmd_term != NULL && !inputBlocked()) {
+        int curr_len = cmd_term - context.buffer.data;
+
+        /* new program message before the response was read */
+        if (context.output.rd != context.output.wr) {
+            SCPI_OutputClear();
+            SCPI_ErrorPush(SCPI_ERROR_QUERY_INTERRUPTED);
+        }
+
+        result = SCPI_Parse(context.buffer.data + ws, curr_len - ws);
+        if (context.parse.rest != NULL) {
+            /* keep the line in buffer until it is resumed */
+            break;
+        }
+        inputShift(curr_len);
+        if (scpi_ingress != NULL) {
+            ingressMove();
+        }
+
+        ws = skipWhitespace(context.buffer.data, context.buffer.position);
+        cmd_term = inputTerminator(ws);
+    }
+
+    return result;
+}
+
+/**
+ * Move window over ring mapped twice back to back. Window never starts in
+ * the mirror, so it can always extend by the whole ring.
+ * @param ring - first mapping of the ring
+ * @param size - size of the ring
+ * @param data - start of the window
+ * @param len - number of bytes to move by, at most size
+ * @return new start of the window
+ */
+static char * ringAdvance(char * ring, size_t size, char * data, size_t len) {
+    data += len;
+    if (data >= ring + size) {
+        data -= size;
+    }
+    return data;
+}
+
+/**
+ * Remove processed data from the beginning of input buffer
+ * @param len - number of bytes to remove
+ */
+void SCPICore::inputShift(size_t len) {
+    if (context.buffer.ring != NULL) {
+        context.buffer.data = ringAdvance(context.buffer.ring, context.buffer.length, context.buffer.data, len);
+    } else {
+        memmove(context.buffer.data, context.buffer.data + len, context.buffer.position - len);
+    }
+    context.buffer.position -= len;
+    context.buffer.scan = (context.buffer.scan > len) ? (context.buffer.scan - len) : 0;
+    inputTerminate();
+}
+
+/**
+ * Terminate received data by NUL. Bytes behind the window of shared ring
+ * belong to the producer, nothing is written there.
+ */
+void SCPICore::inputTerminate() {
+    if (context.buffer.ring == NULL) {
+        context.buffer.data[context.buffer.position] = 0;
+    }
+}
+
+/**
+ * Find command line terminator in input buffer. Data searched before are
+ * skipped, so input received in small pieces is searched only once.
+ * @param ws - start of the command line
+ * @return pointer to command line terminator or NULL
+ */
+const char * SCPICore::inputTerminator(size_t ws) {
+    size_t from = (context.buffer.scan > ws) ? context.buffer.scan : ws;
+    const char * cmd_term = cmdlineTerminator(context.buffer.data + from, context.buffer.position - from);
+
+    context.buffer.scan = (cmd_term != NULL) ? (size_t)(cmd_term - context.buffer.data) : context.buffer.position;
+    return cmd_term;
+}
+
+/**
+ * Make room in input buffer filled by command line longer than the buffer.
+ * Input buffer overrun is reported and the line is discarded up to its
+ * terminator.
+ * @return TRUE if the buffer was emptied
+ */
+scpi_bool_t SCPICore::inputOverrun() {
+    if (context.buffer.position < context.buffer.length - 1) {
+        return FALSE;
+    }
+    if ((context.parse.rest != NULL) || (inputTerminator(0) != NULL)) {
+        return FALSE;
+    }
+
+    if (scpi_units != NULL) {
+        /* transport thread, registers belong to the worker running units */
+        SCPI_ErrorPushAsync(SCPI_ERROR_INPUT_BUFFER_OVERRUN, NULL, 0);
+    } else {
+        SCPI_ErrorPush(SCPI_ERROR_INPUT_BUFFER_OVERRUN);
+    }
+    inputShift(context.buffer.position);
+    context.buffer.overrun = TRUE;
+    return TRUE;
+}
+
+/**
+ * Drop received rest of too long command line
+ */
+void SCPICore::inputDiscard() {
+    const char * cmd_term = cmdlineTerminator(context.buffer.data, context.buffer.position);
+
+    if (cmd_term == NULL) {
+        inputShift(context.buffer.position);
+    } else {
+        context.buffer.overrun = FALSE;
+        inputShift(cmd_term - context.buffer.data);
+    }
+    context.buffer.scan = 0;
+}
+
+/**
+ * Check if processing of following commands has to wait
+ * @return TRUE if a result is still being streamed, if coroutine command
+ * is suspended, if *WAI or *OPC? waits for overlapped commands or if
+ * pipelined response was not read yet
+ */
+scpi_bool_t SCPICore::inputBlocked() {
+    if (context.stream.producer != NULL) {
+        return TRUE;
+    }
+    if (scpi_operations.coroutine != NULL) {
+        return TRUE;
+    }
+    if (scpi_operations.wai || scpi_operations.opcq) {
+        return TRUE;
+    }
+    if (context.output.pipeline && (context.output.rd != context.output.wr)) {
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/* chunk header in ingress ring, length of data with ready flag */
+#define SCPI_INGRESS_HEADER 4
+#define SCPI_INGRESS_READY 0x80000000u
+
+static inline std::atomic<uint32_t> * ingressHeader(char * data, uint32_t pos) {
+    return reinterpret_cast<std::atomic<uint32_t> *>(data + (pos & (SCPI_INGRESS_SIZE - 1)));
+}
+static_assert(sizeof(std::atomic<uint32_t>) == SCPI_INGRESS_HEADER, "chunk header must be plain 32 bit word");
+
+/**
+ * Copy data to ingress ring, wrapping around its end
+ * @param ring - ring data
+ * @param pos - position in ring
+ * @param data - data to copy
+ * @param len - number of bytes
+ */
+static void ingressWrite(char * ring, uint32_t pos, const char * data, size_t len) {
+    size_t offset = pos & (SCPI_INGRESS_SIZE - 1);
+    size_t first = (SCPI_INGRESS_SIZE - offset < len) ? (SCPI_INGRESS_SIZE - offset) : len;
+
+    memcpy(ring + offset, data, first);
+    memcpy(ring, data + first, len - first);
+}
+
+/**
+ * Copy data from ingress ring, wrapping around its end
+ * @param ring - ring data
+ * @param pos - position in ring
+ * @param data - destination
+ * @param len - number of bytes
+ */
+static void ingressRead(const char * ring, uint32_t pos, char * data, size_t len) {
+    size_t offset = pos & (SCPI_INGRESS_SIZE - 1);
+    size_t first = (SCPI_INGRESS_SIZE - offset < len) ? (SCPI_INGRESS_SIZE - offset) : len;
+
+    memcpy(data, ring + offset, first);
+    memcpy(data + first, ring, len - first);
+}
+
+/**
+ * Clear released part of ingress ring
+ * @param ring - ring data
+ * @param pos - position in ring
+ * @param len - number of bytes
+ */
+static void ingressClear(char * ring, uint32_t pos, size_t len) {
+    size_t offset = pos & (SCPI_INGRESS_SIZE - 1);
+    size_t first = (SCPI_INGRESS_SIZE - offset < len) ? (SCPI_INGRESS_SIZE - offset) : len;
+
+    memset(ring + offset, 0, first);
+    memset(ring, 0, len - first);
+}
+
+/**
+ * Let transports push input from other threads with SCPI_IngressPush.
+ * Input is then processed only by SCPI_IngressDrain on the parser thread,
+ * SCPI_Input must not be used anymore.
+ * @param notify - called by the push that finds the parser idle, parser
+ * thread should call SCPI_IngressDrain then
+ * @param user_context - passed to notify
+ * @return 0 on success, -1 if the ring cannot be allocated
+ */
+int SCPICore::SCPI_IngressAttach(void (*notify)(SCPICore * session, void * user_context), void * user_context) {
+    if (scpi_ingress == NULL) {
+        scpi_ingress = new (std::nothrow) scpi_ingress_t;
+        if (scpi_ingress == NULL) {
+            return -1;
+        }
+    }
+    scpi_ingress->wr.store(0, std::memory_order_relaxed);
+    scpi_ingress->rd.store(0, std::memory_order_relaxed);
+    scpi_ingress->wake.store(false, std::memory_order_relaxed);
+    scpi_ingress->offset = 0;
+    scpi_ingress->notify = notify;
+    scpi_ingress->user_context = user_context;
+    memset(scpi_ingress->data, 0, sizeof(scpi_ingress->data));
+    return 0;
+}
+
+/**
+ * Push input to ingress ring, can be called from any thread and never
+ * blocks. Parser is notified only if it does not drain already, so a burst
+ * of pushes costs one wake up. Data are pushed as one piece, so transports
+ * sharing one session should push whole program messages. Only data longer
+ * than the ring are pushed partially.
+ * @param data - data to push
+ * @param len - length of data
+ * @return number of bytes pushed, 0 if the ring is full
+ */
+size_t SCPICore::SCPI_IngressPush(const char * data, size_t len) {
+    scpi_ingress_t * ingress = scpi_ingress;
+    uint32_t wr;
+    uint32_t rd;
+    uint32_t room;
+    uint32_t chunk;
+    uint32_t total;
+
+    if ((ingress == NULL) || (len == 0)) {
+        return 0;
+    }
+
+    /* reserve chunk, all chunks are aligned to the header size */
+    wr = ingress->wr.load(std::memory_order_relaxed);
+    do {
+        rd = ingress->rd.load(std::memory_order_acquire);
+        room = SCPI_INGRESS_SIZE - (wr - rd);
+        if (room <= SCPI_INGRESS_HEADER) {
+            return 0;
+        }
+        chunk = (len < room - SCPI_INGRESS_HEADER) ? (uint32_t)len : (room - SCPI_INGRESS_HEADER);
+        /* data that fit the empty ring are pushed whole or not at all */
+        if ((chunk < len) && (len <= SCPI_INGRESS_SIZE - SCPI_INGRESS_HEADER)) {
+            return 0;
+        }
+        total = SCPI_INGRESS_HEADER + ((chunk + SCPI_INGRESS_HEADER - 1) & ~(uint32_t)(SCPI_INGRESS_HEADER - 1));
+    } while (!ingress->wr.compare_exchange_weak(wr, wr + total, std::memory_order_relaxed));
+
+    ingressWrite(ingress->data, wr + SCPI_INGRESS_HEADER, data, chunk);
+    ingressHeader(ingress->data, wr)->store(chunk | SCPI_INGRESS_READY);
+
+    if (!ingress->wake.exchange(true) && (ingress->notify != NULL)) {
+        ingress->notify(this, ingress->user_context);
+    }
+    return chunk;
+}
+
+/**
+ * Process input pushed to ingress ring, called on the parser thread after
+ * notify. Data stay in the ring while the input buffer is full or blocked
+ * (*WAI, unread response), so producers are throttled by the parser.
+ * @return result of inputProcess or number of queued units if a pool is
+ * attached
+ */
+int SCPICore::SCPI_IngressDrain() {
+    if (scpi_ingress == NULL) {
+        return 0;
+    }
+
+    /* pushes from now on notify again */
+    scpi_ingress->wake.store(false);
+
+    if (scpi_units != NULL) {
+        return dispatchProcess();
+    }
+
+    SCPI_RegSync();
+    SCPI_OperationSync();
+    return inputProcess();
+}
+
+/**
+ * Move committed chunks from ingress ring to the input buffer, as much as
+ * fits. Released part of the ring is cleared, so a chunk header is never
+ * read from stale data.
+ * @return number of moved bytes
+ */
+size_t SCPICore::ingressMove() {
+    scpi_ingress_t * ingress = scpi_ingress;
+    uint32_t rd = ingress->rd.load(std::memory_order_relaxed);
+    size_t moved = 0;
+    size_t space;
+    uint32_t header;
+    uint32_t len;
+    uint32_t total;
+
+    for (;;) {
+        space = context.buffer.length - context.buffer.position - 1;
+        if (space == 0) {
+            if (!inputOverrun()) {
+                break;
+            }
+            continue;
+        }
+
+        header = ingressHeader(ingress->data, rd)->load();
+        if (!(header & SCPI_INGRESS_READY)) {
+            break;
+        }
+
+        len = (header & ~SCPI_INGRESS_READY) - ingress->offset;
+        if (len > space) {
+            len = space;
+        }
+        ingressRead(ingress->data, rd + SCPI_INGRESS_HEADER + ingress->offset, context.buffer.data + context.buffer.position, len);
+        context.buffer.position += len;
+        ingress->offset += len;
+        moved += len;
+
+        if (context.buffer.overrun) {
+            inputDiscard();
+        }
+
+        if (ingress->offset < (header & ~SCPI_INGRESS_READY)) {
+            continue;
+        }
+
+        /* whole chunk moved, release it */
+        total = SCPI_INGRESS_HEADER + ((ingress->offset + SCPI_INGRESS_HEADER - 1) & ~(uint32_t)(SCPI_INGRESS_HEADER - 1));
+        ingressClear(ingress->data, rd, total);
+        ingress->offset = 0;
+        rd += total;
+        ingress->rd.store(rd, std::memory_order_release);
+    }
+
+    inputTerminate();
+    return moved;
+}
+
+/**
+ * Let the pool execute commands of this session. Commands are then
+ * resolved by SCPI_InputDispatch on the transport thread and executed by
+ * the pool. The output queue is not used, results are passed to write on
+ * the worker executing the session, never on two workers at once. MAV is
+ * not maintained, the transport owns the data once write returns.
+ * @param pool
+ * @param write - receives results of the session, interface write if NULL
+ * @param user_context - passed to write
+ * @return 0 on success, -1 if the unit queue cannot be allocated
+ */
+int SCPICore::SCPI_PoolAttach(SCPIWorkerPool * pool, size_t (*write)(SCPICore * session, const char * data, size_t len, void * user_context), void * user_context) {
+    if (scpi_units == NULL) {
+        scpi_units = new (std::nothrow) scpi_units_t;
+        if (scpi_units == NULL) {
+            return -1;
+        }
+    }
+    scpi_units->wr.store(0, std::memory_order_relaxed);
+    scpi_units->rd.store(0, std::memory_order_relaxed);
+    scpi_units->scheduled.store(false, std::memory_order_relaxed);
+    scpi_units->notified.store(false, std::memory_order_relaxed);
+    scpi_units->stalled.store(false, std::memory_order_relaxed);
+    scpi_units->suspended = FALSE;
+    scpi_units->pool = pool;
+    scpi_units->write = write;
+    scpi_units->user_context = user_context;
+
+    context.output.data = NULL;
+    return 0;
+}
+
+/**
+ * Interface to the application when a pool executes commands. Adds data
+ * to the input buffer, resolves commands of complete command lines and
+ * queues them to the session. If the unit queue is full, rest of the input
+ * stays in the buffer until the pool calls drained. Must not be called
+ * concurrently for one session.
+ * @param data - data to process
+ * @param len - length of data, 0 only continues stalled dispatching
+ * @return number of queued units or -1 if input buffer is full
+ */
+int SCPICore::SCPI_InputDispatch(const char * data, size_t len) {
+    size_t buffer_free;
+
+    if (len > 0) {
+        buffer_free = context.buffer.length - context.buffer.position;
+        if (len > (buffer_free - 1)) {
+            return -1;
+        }
+        memcpy(&context.buffer.data[context.buffer.position], data, len);
+        context.buffer.position += len;
+        inputTerminate();
+    }
+
+    return dispatchProcess();
+}
+
+/**
+ * Resolve all complete command lines from input buffer to units
+ * @return number of queued units
+ */
+int SCPICore::dispatchProcess() {
+    uint32_t wr = scpi_units->wr.load(std::memory_order_relaxed);
+    const char * cmd_term;
+    int ws;
+
+    /* finish command line stalled before */
+    if (context.parse.rest != NULL) {
+        if (dispatchCommands(context.parse.rest, context.parse.end)) {
+            inputShift(context.parse.end - context.buffer.data);
+        }
+    }
+
+    if (scpi_ingress != NULL) {
+        ingressMove();
+    }
+
+    ws = skipWhitespace(context.buffer.data, context.buffer.position);
+    cmd_term = inputTerminator(ws);
+    while (context.parse.rest == NULL && cmd_term != NULL) {
+        int curr_len = cmd_term - context.buffer.data;
+
+        context.parse.prev = NULL;
+        context.parse.prev_len = 0;
+        if (!dispatchCommands(context.buffer.data + ws, cmd_term)) {
+            break;
+        }
+        inputShift(curr_len);
+        if (scpi_ingress != NULL) {
+            ingressMove();
+        }
+
+        ws = skipWhitespace(context.buffer.data, context.buffer.position);
+        cmd_term = inputTerminator(ws);
+    }
+
+    wr = scpi_units->wr.load(std::memory_order_relaxed) - wr;
+    if (wr > 0) {
+        scpi_units->pool->schedule(this);
+    }
+    return wr;
+}
+
+/**
+ * Resolve commands of one command line to units. Compound command prefix
+ * is kept in context.parse, like in parseCommands.
+ * @param cmdline_ptr - first command
+ * @param cmdline_end - end of command line
+ * @return FALSE if unit queue got full and rest was stored in context.parse
+ */
+scpi_bool_t SCPICore::dispatchCommands(char * cmdline_ptr, const char * cmdline_end) {
+    size_t cmd_len;
+    size_t cmdline_len;
+    const scpi_command_t * cmd;
+    char * cmdline_ptr_prev = context.parse.prev;
+    size_t cmd_len_prev = context.parse.prev_len;
+
+    context.parse.rest = NULL;
+
+    while (cmdline_ptr < cmdline_end) {
+        if (!unitSpace()) {
+            /* drained is called when a unit gets free */
+            scpi_units->stalled.store(true);
+            if (!unitSpace()) {
+                context.parse.rest = cmdline_ptr;
+                context.parse.end = (char *) cmdline_end;
+                context.parse.prev = cmdline_ptr_prev;
+                context.parse.prev_len = cmd_len_prev;
+                return FALSE;
+            }
+            scpi_units->stalled.store(false);
+        }
+
+        cmd_len = cmdTerminatorPos(cmdline_ptr, cmdline_end - cmdline_ptr);
+        if (cmd_len > 0) {
+            composeCompoundCommand(cmdline_ptr_prev, cmd_len_prev,
+                                   &cmdline_ptr, &cmd_len);
+            cmdline_len = cmdlineSeparatorPos(cmdline_ptr, cmdline_end - cmdline_ptr);
+            cmd = lookupCommand(cmdline_ptr, cmd_len);
+            if (cmd != NULL) {
+                unitPush(cmd, 0, cmdline_ptr + cmd_len, cmdline_len - cmd_len);
+                cmdline_ptr_prev = cmdline_ptr;
+                cmd_len_prev = cmd_len;
+            } else {
+                unitPush(NULL, SCPI_ERROR_UNDEFINED_HEADER, NULL, 0);
+            }
+        }
+        cmdline_ptr += skipCmdLine(cmdline_ptr, cmdline_end - cmdline_ptr);
+        cmdline_ptr += skipWhitespace(cmdline_ptr, cmdline_end - cmdline_ptr);
+    }
+    return TRUE;
+}
+
+/**
+ * Check for free unit, transport side
+ * @return TRUE if a unit can be pushed
+ */
+scpi_bool_t SCPICore::unitSpace() {
+    uint32_t wr = scpi_units->wr.load(std::memory_order_relaxed);
+    return (wr - scpi_units->rd.load()) < SCPI_UNIT_QUEUE_SIZE;
+}
+
+/**
+ * Queue resolved command, transport side. There has to be free unit.
+ * @param cmd - command or NULL for error unit
+ * @param error - error pushed by error unit
+ * @param parameters - parameters of command, copied to the unit
+ * @param length - length of parameters
+ * @return FALSE if parameters were too long and error unit was queued
+ */
+scpi_bool_t SCPICore::unitPush(const scpi_command_t * cmd, int16_t error, const char * parameters, size_t length) {
+    uint32_t wr = scpi_units->wr.load(std::memory_order_relaxed);
+    scpi_cmd_unit_t * unit = &scpi_units->data[wr & (SCPI_UNIT_QUEUE_SIZE - 1)];
+    scpi_bool_t result = TRUE;
+
+    if (length > SCPI_UNIT_PARAMETERS_LENGTH) {
+        cmd = NULL;
+        error = SCPI_ERROR_TOO_MUCH_DATA;
+        length = 0;
+        result = FALSE;
+    }
+
+    unit->cmd = cmd;
+    unit->error = error;
+    unit->length = length;
+    if (length > 0) {
+        memcpy(unit->parameters, parameters, length);
+    }
+    unit->parameters[length] = '\0';
+
+    scpi_units->wr.store(wr + 1, std::memory_order_release);
+    return result;
+}
+
+/**
+ * Release executed unit, pool side. Calls pool drained if dispatching
+ * was stalled.
+ */
+void SCPICore::unitRelease() {
+    SCPIWorkerPool * pool = scpi_units->pool;
+
+    scpi_units->rd.fetch_add(1);
+    if (scpi_units->stalled.load() && scpi_units->stalled.exchange(false)) {
+        if (pool->drained != NULL) {
+            pool->drained(this, pool->user_context);
+        }
+    }
+}
+
+/**
+ * Execute queued units in order, called by the pool on one worker at a
+ * time. Stops if input gets blocked (*WAI, *OPC?, coroutine command).
+ * @param budget - maximal number of units to execute
+ * @return number of executed units
+ */
+size_t SCPICore::SCPI_UnitsRun(size_t budget) {
+    size_t count = 0;
+    uint32_t rd;
+    scpi_cmd_unit_t * unit;
+
+    SCPI_RegSync();
+    SCPI_OperationSync();
+
+    while (count < budget) {
+        if (scpi_units->suspended) {
+            if (scpi_operations.coroutine != NULL) {
+                break;
+            }
+            scpi_units->suspended = FALSE;
+            unitRelease();
+        }
+
+        /* results are written directly, so stream is sent at once */
+        while (SCPI_StreamPull((size_t) -1)) {
+        }
+
+        if (inputBlocked()) {
+            break;
+        }
+
+        rd = scpi_units->rd.load(std::memory_order_relaxed);
+        if (rd == scpi_units->wr.load(std::memory_order_acquire)) {
+            break;
+        }
+        unit = &scpi_units->data[rd & (SCPI_UNIT_QUEUE_SIZE - 1)];
+
+        if (unit->cmd == NULL) {
+            SCPI_ErrorPush(unit->error);
+        } else {
+            context.paramlist.cmd = unit->cmd;
+            context.paramlist.parameters = unit->parameters;
+            context.paramlist.length = unit->length;
+            processCommand();
+        }
+        count++;
+
+        /* parameters stay in the unit until the coroutine finishes */
+        if (scpi_operations.coroutine != NULL) {
+            scpi_units->suspended = TRUE;
+            break;
+        }
+        unitRelease();
+    }
+
+    return count;
+}
+
+/* writing results */
+
+/**
+ * Write raw string result to the output
+ * @param context
+ * @param data
+ * @return
+ */
+size_t SCPICore::SCPI_ResultString(const char * data) {
+    size_t len = strlen(data);
+    size_t result = 0;
+    result += writeDelimiter();
+    result += writeData(data, len);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Write integer value to the result
+ * @param context
+ * @param val
+ * @return
+ */
+size_t SCPICore::SCPI_ResultInt(int32_t val) {
+    char buffer[12];
+    size_t result = 0;
+    size_t len = longToStr(val, buffer, sizeof (buffer));
+    result += writeDelimiter();
+    result += writeData(buffer, len);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Write boolean value to the result
+ * @param context
+ * @param val
+ * @return
+ */
+size_t SCPICore::SCPI_ResultBool(scpi_bool_t val) {
+    return SCPI_ResultInt(val ? 1 : 0);
+}
+
+/**
+ * Write double walue to the result
+ * @param context
+ * @param val
+ * @return
+ */
+#if !SCPI_USE_FIXED_POINT
+size_t SCPICore::SCPI_ResultDouble(double val) {
+    char buffer[32];
+    size_t result = 0;
+    size_t len = doubleToStr(val, buffer, sizeof (buffer));
+    result += writeDelimiter();
+    result += writeData(buffer, len);
+    context.output_count++;
+    return result;
+
+}
+#endif
+
+/**
+ * Write decimal number to the result, formatted without floating point
+ * @param val
+ * @return
+ */
+size_t SCPICore::SCPI_ResultDecimal(scpi_decimal_t val) {
+    char buffer[32];
+    size_t result = 0;
+    size_t len = decimalToStr(val.mantissa, val.exponent, buffer, sizeof (buffer));
+    result += writeDelimiter();
+    result += writeData(buffer, len);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Write string withn " to the result
+ * @param context
+ * @param data
+ * @return
+ */
+size_t SCPICore::SCPI_ResultText(const char * data) {
+    size_t result = 0;
+    result += writeDelimiter();
+    result += writeData("\"", 1);
+    result += writeData(data, strlen(data));
+    result += writeData("\"", 1);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Write arbitrary block program data (IEEE 488.2 7.7.6) to the result.
+ * Delimiter, block header and data are written with one vectored write,
+ * data are not copied.
+ * @param data - block content
+ * @param len - length of block content
+ * @return number of bytes written
+ */
+size_t SCPICore::SCPI_ResultArbitraryBlock(const char * data, size_t len) {
+    char header[12];
+    scpi_iovec_t iov[3];
+    size_t iovcnt = 0;
+    size_t result;
+
+    if (context.output_count > 0) {
+        iov[iovcnt].base = ", ";
+        iov[iovcnt].len = 2;
+        iovcnt++;
+    }
+
+    /* definite length block holds at most 9 digits of length,
+     * longer blocks are sent as indefinite length block */
+    header[0] = '#';
+    if (len <= 999999999) {
+        size_t digits = longToStr(len, header + 2, sizeof (header) - 2);
+        header[1] = '0' + digits;
+        iov[iovcnt].len = digits + 2;
+    } else {
+        header[1] = '0';
+        iov[iovcnt].len = 2;
+    }
+    iov[iovcnt].base = header;
+    iovcnt++;
+
+    iov[iovcnt].base = data;
+    iov[iovcnt].len = len;
+    iovcnt++;
+
+    result = writeDataVector(iov, iovcnt);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Write result produced on demand. Producer is called from SCPI_StreamPull
+ * each time the transport is able to take more data, so result of any size
+ * is sent with bounded memory. Following commands are not processed until
+ * the stream ends.
+ * @param producer - callback returning chunks of the result
+ * @param user_context - value passed to the producer
+ * @return number of bytes written
+ */
+size_t SCPICore::SCPI_ResultStream(scpi_stream_producer_t producer, void * user_context) {
+    size_t result = 0;
+
+    if (producer == NULL || context.stream.producer != NULL) {
+        return 0;
+    }
+
+    result += writeDelimiter();
+    context.stream.producer = producer;
+    context.stream.user_context = user_context;
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Send next chunk of streamed result. Should be called by the transport
+ * whenever it is able to accept len more bytes.
+ * @param len - maximum number of bytes to send
+ * @return 1 if the stream continues, 0 if there is no stream (anymore)
+ */
+int SCPICore::SCPI_StreamPull(size_t len) {
+    const char * data = NULL;
+    size_t chunk;
+
+    if (context.stream.producer == NULL) {
+        return 0;
+    }
+
+    /* keep space for terminating new line in output queue */
+    if (context.output.data != NULL) {
+        size_t space = outputFree();
+        if (space <= 2 || context.output.spill_len > 0) {
+            return 1;
+        }
+        len = min(len, space - 2);
+    }
+
+    chunk = (this->*context.stream.producer)(&data, len, context.stream.user_context);
+    if (chunk > 0) {
+        writeData(data, chunk);
+        return 1;
+    }
+
+    /* end of stream - terminate result and continue with queued commands */
+    context.stream.producer = NULL;
+    context.stream.user_context = NULL;
+    writeNewLine();
+    inputProcess();
+    return 0;
+}
+
+/**
+ * Append data to output queue. Response which does not fit into the queue
+ * continues in spill buffer, it is discarded and Query DEADLOCKED is
+ * reported only if the spill buffer can not be allocated.
+ * @param data
+ * @param len - lenght of data to be written
+ * @return number of bytes written
+ */
+size_t SCPICore::outputWrite(const char * data, size_t len) {
+    if (context.output.overflow) {
+        return 0;
+    }
+
+    if (context.output.spill_len == 0 && len > context.output.length - context.output.wr) {
+        /* move unread data to the beginning of the queue */
+        outputRelease(context.output.rd);
+    }
+
+    if (context.output.spill_len > 0 || len > context.output.length - context.output.wr) {
+        return outputSpill(data, len);
+    }
+
+    memcpy(context.output.data + context.output.wr, data, len);
+    context.output.wr += len;
+    context.output.message += len;
+    outputUpdateMAV();
+    return len;
+}
+
+/**
+ * Append data behind the output queue, queue is filled first. Spill buffer
+ * grows by doubling and is freed when it is read.
+ * @param data
+ * @param len - lenght of data to be written
+ * @return number of bytes written
+ */
+size_t SCPICore::outputSpill(const char * data, size_t len) {
+    size_t size = context.output.spill_size;
+    size_t message;
+    size_t first;
+    char * spill;
+
+    if (context.output.spill_len == 0) {
+        first = min(len, context.output.length - context.output.wr);
+        memcpy(context.output.data + context.output.wr, data, first);
+        context.output.wr += first;
+        context.output.message += first;
+        data += first;
+        len -= first;
+    }
+
+    if (context.output.spill_len + len > size) {
+        if (size == 0) {
+            size = context.output.length;
+        }
+        while (size < context.output.spill_len + len) {
+            size *= 2;
+        }
+        spill = (char *) realloc(context.output.spill, size);
+        if (spill == NULL) {
+            /* drop unread part of the response message */
+            message = min(context.output.message, context.output.spill_len - context.output.spill_rd);
+            context.output.spill_len -= message;
+            context.output.message -= message;
+            context.output.wr -= min(context.output.message, context.output.wr - context.output.rd);
+            context.output.message = 0;
+            context.output.overflow = TRUE;
+            outputUpdateMAV();
+            SCPI_ErrorPush(SCPI_ERROR_QUERY_DEADLOCKED);
+            return 0;
+        }
+        context.output.spill = spill;
+        context.output.spill_size = size;
+    }
+
+    memcpy(context.output.spill + context.output.spill_len, data, len);
+    context.output.spill_len += len;
+    context.output.message += len;
+    outputUpdateMAV();
+    return len;
+}
+
+/**
+ * Move spilled data to output queue as it gets free, free the spill buffer
+ * when all its data are moved
+ */
+void SCPICore::outputDrain() {
+    size_t len;
+
+    if (context.output.spill_len == 0) {
+        return;
+    }
+
+    outputRelease(context.output.rd);
+    len = min(context.output.spill_len - context.output.spill_rd, context.output.length - context.output.wr);
+    memcpy(context.output.data + context.output.wr, context.output.spill + context.output.spill_rd, len);
+    context.output.wr += len;
+    context.output.spill_rd += len;
+
+    if (context.output.spill_rd == context.output.spill_len) {
+        free(context.output.spill);
+        context.output.spill = NULL;
+        context.output.spill_rd = 0;
+        context.output.spill_len = 0;
+        context.output.spill_size = 0;
+    }
+}
+
+/**
+ * Remove read data from the beginning of output queue. Window over shared
+ * ring moves instead of the data, the reader may still use unread part.
+ * @param len - number of bytes, at most rd
+ */
+void SCPICore::outputRelease(size_t len) {
+    if (context.output.ring != NULL) {
+        context.output.data = ringAdvance(context.output.ring, context.output.length, context.output.data, len);
+    } else {
+        memmove(context.output.data, context.output.data + len, context.output.wr - len);
+    }
+    context.output.rd -= len;
+    context.output.wr -= len;
+}
+
+/**
+ * Get free space in output queue
+ * @return number of bytes
+ */
+size_t SCPICore::outputFree() {
+    return context.output.length - (context.output.wr - context.output.rd);
+}
+
+/**
+ * Set or clear MAV bit of STB according to output queue
+ */
+void SCPICore::outputUpdateMAV() {
+    scpi_bool_t mav = (context.output.rd != context.output.wr);
+    scpi_bool_t stb_mav = (SCPI_RegGet(SCPI_REG_STB) & STB_MAV) ? TRUE : FALSE;
+
+    if (mav && !stb_mav) {
+        SCPI_RegSetBits(SCPI_REG_STB, STB_MAV);
+    } else if (!mav && stb_mav) {
+        SCPI_RegClearBits(SCPI_REG_STB, STB_MAV);
+    }
+}
+
+/**
+ * Get unread data of output queue without copying them. If the queue is
+ * empty, next chunk of streamed result is fetched.
+ * @param data - pointer to the first unread byte
+ * @return number of continuous bytes available at *data
+ */
+size_t SCPICore::SCPI_OutputPeek(const char ** data) {
+    if (context.output.data == NULL) {
+        return 0;
+    }
+
+    if (context.output.rd == context.output.wr) {
+        SCPI_OperationSync();
+        outputDrain();
+    }
+    if (context.output.rd == context.output.wr) {
+        SCPI_StreamPull(context.output.length);
+    }
+
+    *data = context.output.data + context.output.rd;
+    return context.output.wr - context.output.rd;
+}
+
+/**
+ * Mark data from output queue as read. When the queue gets empty, MAV is
+ * cleared and waiting commands are processed.
+ * @param len - number of bytes read
+ */
+void SCPICore::SCPI_OutputConsume(size_t len) {
+    len = min(len, context.output.wr - context.output.rd);
+    context.output.rd += len;
+
+    if (context.output.rd == context.output.wr && context.output.spill_len > 0) {
+        outputDrain();
+    } else if (context.output.rd == context.output.wr) {
+        outputRelease(context.output.rd);
+        context.output.message = 0;
+        outputUpdateMAV();
+        if (!SCPI_StreamPull(context.output.length)) {
+            inputProcess();
+        }
+    }
+}
+
+/**
+ * Read request of the controller. Copies data from output queue, reading
+ * from empty queue without pending query is Query UNTERMINATED. Response
+ * still owed by *OPC?, a stream, a suspended command or a waiting command
+ * line is not an error, the read returns 0 bytes.
+ * @param data - target buffer
+ * @param len - size of target buffer
+ * @return number of bytes read
+ */
+size_t SCPICore::SCPI_OutputRead(char * data, size_t len) {
+    const char * ptr;
+    size_t result = 0;
+    size_t count;
+
+    while (result < len) {
+        count = SCPI_OutputPeek(&ptr);
+        if (count == 0) {
+            break;
+        }
+        count = min(count, len - result);
+        memcpy(data + result, ptr, count);
+        SCPI_OutputConsume(count);
+        result += count;
+    }
+
+    if (result == 0 && context.output.data != NULL && SCPI_InputIdle()) {
+        SCPI_ErrorPush(SCPI_ERROR_QUERY_UNTERMINATED);
+    }
+
+    return result;
+}
+
+/**
+ * Get number of unread bytes in output queue
+ * @return
+ */
+size_t SCPICore::SCPI_OutputCount() {
+    return context.output.wr - context.output.rd + context.output.spill_len - context.output.spill_rd;
+}
+
+/**
+ * Clear output queue (device clear, interrupted query)
+ */
+void SCPICore::SCPI_OutputClear() {
+    free(context.output.spill);
+    context.output.spill = NULL;
+    context.output.spill_rd = 0;
+    context.output.spill_len = 0;
+    context.output.spill_size = 0;
+    context.output.rd = context.output.wr;
+    outputRelease(context.output.rd);
+    context.output.message = 0;
+    outputUpdateMAV();
+}
+
+/**
+ * Place output queue to ring shared with the reader, responses are then
+ * written directly to it. The ring has to be mapped twice back to back
+ * (size bytes followed by their mirror), so every response is continuous.
+ * Read data are released by SCPI_OutputConsume only. Pipeline has to stay
+ * set, SCPI_OutputClear drops data the reader may already see.
+ * @param ring - first mapping of the ring
+ * @param size - size of the ring
+ */
+void SCPICore::SCPI_OutputAttach(char * ring, size_t size) {
+    context.output.ring = ring;
+    context.output.data = ring;
+    context.output.length = size;
+    context.output.rd = 0;
+    context.output.wr = 0;
+    context.output.message = 0;
+    context.output.overflow = FALSE;
+    context.output.pipeline = TRUE;
+    outputUpdateMAV();
+}
+
+/**
+ * Set terminator of response messages, "\r\n" by default. Serial links
+ * commonly expect "\n" only.
+ * @param terminator - static string, not empty
+ */
+void SCPICore::SCPI_ResponseTerminator(const char * terminator) {
+    context.output.terminator = terminator;
+    context.output.terminator_len = strlen(terminator);
+}
+
+/**
+ * Check if output queue holds the rest of the response message, so the
+ * transport can mark its end (HiSLIP DataEND, GPIB EOI)
+ * @return FALSE if a result is being streamed, commands of received
+ * program message wait or still run
+ */
+scpi_bool_t SCPICore::SCPI_ResponseComplete() {
+    return SCPI_InputIdle();
+}
+
+/**
+ * Write error queue entry to the result as <code>,"<text>[;<detail>]",
+ * quotes in detail text are doubled
+ * @param error
+ * @return
+ */
+size_t SCPICore::SCPI_ResultError(const scpi_error_t * error) {
+    char buffer[12];
+    const char * text = SCPI_ErrorTranslate(error->code);
+    const char * info = error->info;
+    const char * quote;
+    size_t info_len = error->info_len;
+    size_t result = 0;
+    size_t len = longToStr(error->code, buffer, sizeof (buffer));
+
+    result += writeDelimiter();
+    result += writeData(buffer, len);
+    result += writeData(",\"", 2);
+    result += writeData(text, strlen(text));
+    if (info_len > 0) {
+        result += writeData(";", 1);
+        while ((quote = (const char *) memchr(info, '"', info_len)) != NULL) {
+            len = quote - info + 1;
+            result += writeData(info, len);
+            result += writeData("\"", 1);
+            info += len;
+            info_len -= len;
+        }
+        result += writeData(info, info_len);
+    }
+    result += writeData("\"", 1);
+    context.output_count++;
+    return result;
+}
+
+/**
+ * Get length of error result written by SCPI_ResultError
+ * @param error
+ * @return number of bytes including delimiter
+ */
+size_t SCPICore::resultErrorLength(const scpi_error_t * error) {
+    char buffer[12];
+    size_t result = longToStr(error->code, buffer, sizeof (buffer));
+    size_t i;
+
+    result += (context.output_count > 0) ? 2 : 0;
+    result += 3 + strlen(SCPI_ErrorTranslate(error->code));
+    if (error->info_len > 0) {
+        result += 1 + error->info_len;
+        for (i = 0; i < error->info_len; i++) {
+            if (error->info[i] == '"') {
+                result++;
+            }
+        }
+    }
+    return result;
+}
+
+/* parsing parameters */
+
+/**
+ * Skip num bytes from the begginig of parameters
+ * @param context
+ * @param num
+ */
+void SCPICore::paramSkipBytes(size_t num) {
+    if (context.paramlist.length < num) {
+        num = context.paramlist.length;
+    }
+    context.paramlist.parameters += num;
+    context.paramlist.length -= num;
+}
+
+/**
+ * Skip white spaces from the beggining of parameters
+ * @param context
+ */
+void SCPICore::paramSkipWhitespace() {
+    size_t ws = skipWhitespace(context.paramlist.parameters, context.paramlist.length);
+    paramSkipBytes(ws);
+}
+
+/**
+ * Find next parameter
+ * @param context
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::paramNext(scpi_bool_t mandatory) {
+    paramSkipWhitespace();
+    if (context.paramlist.length == 0) {
+        if (mandatory) {
+            SCPI_ErrorPush(SCPI_ERROR_MISSING_PARAMETER);
+        }
+        return FALSE;
+    }
+    if (context.input_count != 0) {
+        if (context.paramlist.parameters[0] == ',') {
+            paramSkipBytes(1);
+            paramSkipWhitespace();
+        } else {
+            SCPI_ErrorPush(SCPI_ERROR_INVALID_SEPARATOR);
+            return FALSE;
+        }
+    }
+    context.input_count++;
+    return TRUE;
+}
+
+/**
+ * Parse integer parameter
+ * @param context
+ * @param value
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamInt(int32_t * value, scpi_bool_t mandatory) {
+    const char * param;
+    size_t param_len;
+    size_t num_len;
+
+    if (!value) {
+        return FALSE;
+    }
+
+    if (!SCPI_ParamString(&param, &param_len, mandatory)) {
+        return FALSE;
+    }
+
+    num_len = strToLong(param, value);
+
+    if (num_len != param_len) {
+        SCPI_ErrorPush(SCPI_ERROR_SUFFIX_NOT_ALLOWED);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Parse double parameter
+ * @param context
+ * @param value
+ * @param mandatory
+ * @return
+ */
+#if !SCPI_USE_FIXED_POINT
+scpi_bool_t SCPICore::SCPI_ParamDouble(double * value, scpi_bool_t mandatory) {
+    const char * param;
+    size_t param_len;
+    size_t num_len;
+
+    if (!value) {
+        return FALSE;
+    }
+
+    if (!SCPI_ParamString(&param, &param_len, mandatory)) {
+        return FALSE;
+    }
+
+    num_len = strToDouble(param, value);
+
+    if (num_len != param_len) {
+        SCPI_ErrorPush(SCPI_ERROR_SUFFIX_NOT_ALLOWED);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+#endif
+
+/**
+ * Parse decimal parameter without floating point
+ * @param value - mantissa and decimal exponent
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamDecimal(scpi_decimal_t * value, scpi_bool_t mandatory) {
+    const char * param;
+    size_t param_len;
+    size_t num_len;
+
+    if (!value) {
+        return FALSE;
+    }
+
+    if (!SCPI_ParamString(&param, &param_len, mandatory)) {
+        return FALSE;
+    }
+
+    num_len = strToDecimal(param, &value->mantissa, &value->exponent);
+
+    if (num_len != param_len) {
+        SCPI_ErrorPush(SCPI_ERROR_SUFFIX_NOT_ALLOWED);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Parse string parameter
+ * @param context
+ * @param value
+ * @param len
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamString(const char ** value, size_t * len, scpi_bool_t mandatory) {
+    size_t length;
+
+    if (!value || !len) {
+        return FALSE;
+    }
+
+    if (!paramNext(mandatory)) {
+        return FALSE;
+    }
+
+    if (locateStr(context.paramlist.parameters, context.paramlist.length, value, &length)) {
+        paramSkipBytes(length);
+        paramSkipWhitespace();
+        if (len) {
+            *len = length;
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Parse text parameter (can be inside "")
+ * @param context
+ * @param value
+ * @param len
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamText(const char ** value, size_t * len, scpi_bool_t mandatory) {
+    size_t length;
+
+    if (!value || !len) {
+        return FALSE;
+    }
+
+    if (!paramNext(mandatory)) {
+        return FALSE;
+    }
+
+    if (locateText(context.paramlist.parameters, context.paramlist.length, value, &length)) {
+        paramSkipBytes(length);
+        if (len) {
+            *len = length;
+        }
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+/**
+ * Parse boolean parameter as described in the spec SCPI-99 7.3 Boolean Program Data
+ * @param context
+ * @param value
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamBool(scpi_bool_t * value, scpi_bool_t mandatory) {
+    const char * param;
+    size_t param_len;
+    size_t num_len;
+    int32_t i;
+
+    if (!value) {
+        return FALSE;
+    }
+
+    if (!SCPI_ParamString(&param, &param_len, mandatory)) {
+        return FALSE;
+    }
+
+    if (matchPattern("ON", 2, param, param_len)) {
+        *value = TRUE;
+    } else if (matchPattern("OFF", 3, param, param_len)) {
+        *value = FALSE;
+    } else {
+        num_len = strToLong(param, &i);
+
+        if (num_len != param_len) {
+            SCPI_ErrorPush(SCPI_ERROR_SUFFIX_NOT_ALLOWED);
+            return FALSE;
+        }
+
+        *value = i ? TRUE : FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Parse choice parameter
+ * @param context
+ * @param options
+ * @param value
+ * @param mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamChoice(const char * options[], int32_t * value, scpi_bool_t mandatory) {
+    const char * param;
+    size_t param_len;
+    size_t res;
+
+    if (!options || !value) {
+        return FALSE;
+    }
+
+    if (!SCPI_ParamString(&param, &param_len, mandatory)) {
+        return FALSE;
+    }
+
+    for (res = 0; options[res]; ++res) {
+        if (matchPattern(options[res], strlen(options[res]), param, param_len)) {
+            *value = res;
+            return TRUE;
+        }
+    }
+
+    SCPI_ErrorPush(SCPI_ERROR_ILLEGAL_PARAMETER_VALUE);
+    return FALSE;
+}
+
+/**
+ * Compare numbers of the active number profile
+ * @param a
+ * @param b
+ * @return TRUE if a is less than b
+ */
+static SCPICore::scpi_bool_t realLess(scpi_real_t a, scpi_real_t b) {
+#if SCPI_USE_FIXED_POINT
+    /* align to the smaller exponent, number which would overflow is the
+     * bigger one by magnitude */
+    while (a.exponent > b.exponent) {
+        if (a.mantissa > INT64_MAX / 10 || a.mantissa < -(INT64_MAX / 10)) {
+            return a.mantissa < 0;
+        }
+        a.mantissa *= 10;
+        a.exponent--;
+    }
+    while (b.exponent > a.exponent) {
+        if (b.mantissa > INT64_MAX / 10 || b.mantissa < -(INT64_MAX / 10)) {
+            return b.mantissa > 0;
+        }
+        b.mantissa *= 10;
+        b.exponent--;
+    }
+    return a.mantissa < b.mantissa;
+#else
+    return a < b;
+#endif
+}
+
+/**
+ * Parse one parameter of bound command, resolve MINimum, MAXimum and
+ * DEFault and check its range
+ * @param param - parameter definition
+ * @param str - parameter text
+ * @param len - length of parameter text
+ * @param value - parsed value
+ * @return TRUE on success, error is pushed otherwise
+ */
+scpi_bool_t SCPICore::paramValue(const scpi_param_def_t * param, const char * str, size_t len, scpi_param_value_t * value) {
+    scpi_number_t number;
+    size_t num_len;
+    int32_t i;
+
+    switch (param->kind) {
+    case SCPI_PARAM_NUMBER:
+    case SCPI_PARAM_INT:
+        if (translateSpecialNumber(context.instrument->special_numbers, str, len, &number)) {
+            if (!paramLimit(param, number.type, value)) {
+                SCPI_ErrorPush(SCPI_ERROR_ILLEGAL_PARAMETER_VALUE);
+                return FALSE;
+            }
+            return TRUE;
+        }
+        break;
+
+    case SCPI_PARAM_BOOL:
+        if (matchPattern("ON", 2, str, len)) {
+            value->flag = TRUE;
+            return TRUE;
+        }
+        if (matchPattern("OFF", 3, str, len)) {
+            value->flag = FALSE;
+            return TRUE;
+        }
+        break;
+
+    case SCPI_PARAM_CHOICE:
+        for (i = 0; param->options[i] != NULL; i++) {
+            if (matchPattern(param->options[i], strlen(param->options[i]), str, len)) {
+                value->integer = i;
+                return TRUE;
+            }
+        }
+        SCPI_ErrorPush(SCPI_ERROR_ILLEGAL_PARAMETER_VALUE);
+        return FALSE;
+    }
+
+    if (param->kind == SCPI_PARAM_NUMBER) {
+#if SCPI_USE_FIXED_POINT
+        num_len = strToDecimal(str, &number.value.mantissa, &number.value.exponent);
+#else
+        num_len = strToDouble(str, &number.value);
+#endif
+        if (num_len == 0 || num_len > len) {
+            SCPI_ErrorPush(SCPI_ERROR_DATA_TYPE_ERROR);
+            return FALSE;
+        }
+        if (!transformNumber(str + num_len, len - num_len, &number)) {
+            return FALSE;
+        }
+        if (number.unit != SCPI_UNIT_NONE && number.unit != param->unit) {
+            SCPI_ErrorPush(SCPI_ERROR_INVALID_SUFFIX);
+            return FALSE;
+        }
+        if (realLess(number.value, param->min) || realLess(param->max, number.value)) {
+            SCPI_ErrorPush(SCPI_ERROR_DATA_OUT_OF_RANGE);
+            return FALSE;
+        }
+        value->number = number.value;
+        return TRUE;
+    }
+
+    /* integer and boolean */
+    num_len = strToLong(str, &i);
+    if (num_len == 0) {
+        SCPI_ErrorPush(SCPI_ERROR_DATA_TYPE_ERROR);
+        return FALSE;
+    }
+    if (num_len != len) {
+        SCPI_ErrorPush(SCPI_ERROR_SUFFIX_NOT_ALLOWED);
+        return FALSE;
+    }
+    if (param->kind == SCPI_PARAM_BOOL) {
+        value->flag = i ? TRUE : FALSE;
+        return TRUE;
+    }
+    if (i < param->imin || i > param->imax) {
+        SCPI_ErrorPush(SCPI_ERROR_DATA_OUT_OF_RANGE);
+        return FALSE;
+    }
+    value->integer = i;
+    return TRUE;
+}
+
+/**
+ * Resolve MINimum, MAXimum and DEFault by the schema
+ * @param param - number or integer parameter definition
+ * @param type - special number
+ * @param value - resolved value
+ * @return FALSE if the parameter has no such value
+ */
+scpi_bool_t SCPICore::paramLimit(const scpi_param_def_t * param, scpi_special_number_t type, scpi_param_value_t * value) {
+    if (type != SCPI_NUM_MIN && type != SCPI_NUM_MAX && type != SCPI_NUM_DEF) {
+        return FALSE;
+    }
+
+    if (param->kind == SCPI_PARAM_INT) {
+        value->integer = (type == SCPI_NUM_MIN) ? param->imin : (type == SCPI_NUM_MAX) ? param->imax : param->idef;
+    } else if (param->kind == SCPI_PARAM_NUMBER) {
+        value->number = (type == SCPI_NUM_MIN) ? param->min : (type == SCPI_NUM_MAX) ? param->max : param->def;
+    } else {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * Parse all parameters of bound command in one pass. Separators, missing
+ * parameters, types and ranges are checked before the handler is called.
+ * @param params - schema of the command
+ * @param count - number of parameters
+ * @param values - parsed values, count items
+ * @return TRUE on success, error is pushed otherwise
+ */
+scpi_bool_t SCPICore::SCPI_ParamSchema(const scpi_param_def_t * params, size_t count, scpi_param_value_t * values) {
+    const char * ptr = context.paramlist.parameters;
+    size_t len = context.paramlist.length;
+    const char * param;
+    size_t param_len;
+    size_t ws;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        ws = skipWhitespace(ptr, len);
+        ptr += ws;
+        len -= ws;
+        if (i > 0 && len > 0) {
+            if (*ptr != ',') {
+                SCPI_ErrorPush(SCPI_ERROR_INVALID_SEPARATOR);
+                return FALSE;
+            }
+            ws = skipWhitespace(ptr + 1, len - 1) + 1;
+            ptr += ws;
+            len -= ws;
+        }
+        if (len == 0) {
+            SCPI_ErrorPush(SCPI_ERROR_MISSING_PARAMETER);
+            return FALSE;
+        }
+
+        if (!locateStr(ptr, len, &param, &param_len)) {
+            SCPI_ErrorPush(SCPI_ERROR_DATA_TYPE_ERROR);
+            return FALSE;
+        }
+        if (!paramValue(&params[i], param, param_len, &values[i])) {
+            return FALSE;
+        }
+        len -= (param + param_len) - ptr;
+        ptr = param + param_len;
+    }
+
+    context.paramlist.parameters = ptr;
+    context.paramlist.length = len;
+    context.input_count += count;
+    return TRUE;
+}
+
+/* settings */
+
+scpi_setting_t::scpi_setting_t(const scpi_param_def_t & param) :
+    param(param),
+    sequence(0),
+    changed(NULL),
+    user_context(NULL)
+{
+    scpi_param_value_t value;
+
+    set.invoke = SCPICore::settingSet;
+    set.params = &this->param;
+    set.count = 1;
+    set.target = this;
+    query.invoke = SCPICore::settingQuery;
+    query.params = &this->param;
+    query.count = 0;
+    query.target = this;
+
+    memset(&value, 0, sizeof(value));
+    if (param.kind == SCPI_PARAM_NUMBER) {
+        value.number = param.def;
+    } else if (param.kind == SCPI_PARAM_BOOL) {
+        value.flag = param.idef ? TRUE : FALSE;
+    } else {
+        value.integer = param.idef;
+    }
+    SCPICore::SCPI_SettingSet(this, &value);
+}
+
+/**
+ * Read value of setting, from any thread
+ * @param setting
+ * @param value
+ */
+void SCPICore::SCPI_SettingGet(const scpi_setting_t * setting, scpi_param_value_t * value) {
+    uint32_t words[SCPI_SETTING_WORDS];
+    uint32_t seq;
+    size_t i;
+
+    /* odd sequence or changed sequence - a write overlapped, read again */
+    do {
+        seq = setting->sequence.load(std::memory_order_acquire);
+        for (i = 0; i < SCPI_SETTING_WORDS; i++) {
+            words[i] = setting->data[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) || (seq != setting->sequence.load(std::memory_order_relaxed)));
+
+    memcpy(value, words, sizeof(*value));
+}
+
+/**
+ * Write value of setting, from any thread. Value is not checked against
+ * the schema and changed is not called.
+ * @param setting
+ * @param value
+ */
+void SCPICore::SCPI_SettingSet(scpi_setting_t * setting, const scpi_param_value_t * value) {
+    uint32_t words[SCPI_SETTING_WORDS];
+    uint32_t seq = setting->sequence.load(std::memory_order_relaxed);
+    size_t i;
+
+    memset(words, 0, sizeof(words));
+    memcpy(words, value, sizeof(*value));
+
+    /* odd sequence marks the write, other writers wait for even one */
+    do {
+        while (seq & 1) {
+            seq = setting->sequence.load(std::memory_order_relaxed);
+        }
+    } while (!setting->sequence.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (i = 0; i < SCPI_SETTING_WORDS; i++) {
+        setting->data[i].store(words[i], std::memory_order_relaxed);
+    }
+    setting->sequence.store(seq + 2, std::memory_order_release);
+}
+
+/**
+ * Generated setter: parse the value by the schema and store it
+ * @param session
+ * @param binding - set binding of the setting
+ * @return
+ */
+scpi_result_t SCPICore::settingSet(SCPICore * session, const scpi_binding_t * binding) {
+    scpi_setting_t * setting = (scpi_setting_t *) binding->target;
+    scpi_param_value_t value;
+
+    if (!session->SCPI_ParamSchema(&setting->param, 1, &value)) {
+        return SCPI_RES_ERR;
+    }
+
+    SCPI_SettingSet(setting, &value);
+    if (setting->changed != NULL) {
+        setting->changed(setting, setting->user_context);
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * Generated query: current value, or MINimum, MAXimum and DEFault of the
+ * schema given as parameter
+ * @param session
+ * @param binding - query binding of the setting
+ * @return
+ */
+scpi_result_t SCPICore::settingQuery(SCPICore * session, const scpi_binding_t * binding) {
+    const scpi_setting_t * setting = (const scpi_setting_t *) binding->target;
+    scpi_param_value_t value;
+    scpi_number_t special;
+    const char * str;
+    size_t len;
+
+    if (session->SCPI_ParamString(&str, &len, FALSE)) {
+        if (!session->translateSpecialNumber(session->context.instrument->special_numbers, str, len, &special)
+                || !session->paramLimit(&setting->param, special.type, &value)) {
+            session->SCPI_ErrorPush(SCPI_ERROR_ILLEGAL_PARAMETER_VALUE);
+            return SCPI_RES_ERR;
+        }
+    } else {
+        SCPI_SettingGet(setting, &value);
+    }
+
+    session->settingResult(&setting->param, &value);
+    return SCPI_RES_OK;
+}
+
+/**
+ * Write value of setting to the result, choice by short form of its option.
+ * Choice out of options (set by SCPI_SettingSet) is Execution error.
+ * @param param - schema
+ * @param value
+ * @return
+ */
+size_t SCPICore::settingResult(const scpi_param_def_t * param, const scpi_param_value_t * value) {
+    const char * option;
+    size_t len;
+    size_t result = 0;
+    int32_t i;
+
+    switch (param->kind) {
+    case SCPI_PARAM_NUMBER:
+#if SCPI_USE_FIXED_POINT
+        return SCPI_ResultDecimal(value->number);
+#else
+        return SCPI_ResultDouble(value->number);
+#endif
+    case SCPI_PARAM_INT:
+        return SCPI_ResultInt(value->integer);
+    case SCPI_PARAM_BOOL:
+        return SCPI_ResultBool(value->flag);
+    case SCPI_PARAM_CHOICE:
+        break;
+    }
+
+    for (i = 0; param->options[i] != NULL && i < value->integer; i++) {
+    }
+    if (value->integer < 0 || param->options[i] == NULL) {
+        SCPI_ErrorPush(SCPI_ERROR_EXECUTION_ERROR);
+        return 0;
+    }
+
+    option = param->options[i];
+    for (len = 0; option[len] != '\0' && !islower((unsigned char) option[len]); len++) {
+    }
+    result += writeDelimiter();
+    result += writeData(option, len);
+    context.output_count++;
+    return result;
+}
+
+
+
+void SCPICore::SCPI_ErrorInit()
+{
+    /*
+     * // FreeRTOS
+     * context.error_queue = (scpi_error_queue_t)xQueueCreate(100, sizeof(int16_t));
+     */
+
+    /* basic FIFO */
+    context.error_queue = (scpi_error_queue_t)&local_error_queue;
+    fifo_init((fifo_t *)context.error_queue);
+}
+
+/**
+ * Clear error queue
+ * @param context - scpi context
+ */
+void SCPICore::SCPI_ErrorClear()
+{
+    /*
+     * // FreeRTOS
+     * xQueueReset((xQueueHandle)context.error_queue);
+     */
+
+    /* basic FIFO */
+    fifo_clear((fifo_t *)context.error_queue);
+}
+
+/**
+ * Pop error from queue
+ * @param context - scpi context
+ * @return error number
+ */
+int16_t SCPICore::SCPI_ErrorPop()
+{
+    scpi_error_t error;
+
+    SCPI_ErrorPopEx(&error);
+
+    return error.code;
+}
+
+/**
+ * Pop error from queue including its detail text
+ * @param error - popped error, code is 0 if the queue is empty
+ * @return FALSE if the queue is empty
+ */
+scpi_bool_t SCPICore::SCPI_ErrorPopEx(scpi_error_t * error)
+{
+    /*
+     * // FreeRTOS
+     * if (pdFALSE == xQueueReceive((xQueueHandle)context.error_queue, error, 0)) {
+     *   error->code = 0;
+     * }
+     */
+
+    /* basic FIFO */
+    SCPI_RegSync();
+    if (!fifo_remove((fifo_t *)context.error_queue, error)) {
+        error->code = 0;
+        error->info_len = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Get next error from queue without removing it
+ * @param error - next error, code is 0 if the queue is empty
+ * @return FALSE if the queue is empty
+ */
+scpi_bool_t SCPICore::SCPI_ErrorPeekEx(scpi_error_t * error)
+{
+    SCPI_RegSync();
+    if (!fifo_peek((fifo_t *)context.error_queue, error)) {
+        error->code = 0;
+        error->info_len = 0;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * Push error to queue
+ * @param context - scpi context
+ * @param err - error number
+ */
+void SCPICore::SCPI_ErrorPush(int16_t err) {
+    SCPI_ErrorPushEx(err, NULL, 0);
+}
+
+/**
+ * Push error with detail text to queue, e.g. "CH3 value 12.5". Text longer
+ * than SCPI_ERROR_INFO_LENGTH is truncated.
+ * @param err - error number
+ * @param info - detail text or NULL
+ * @param info_len - length of detail text
+ */
+void SCPICore::SCPI_ErrorPushEx(int16_t err, const char * info, size_t info_len) {
+    scpi_error_t error;
+
+    errorFill(&error, err, info, info_len);
+    SCPI_ErrorAddInternal(&error);
+
+    SCPI_RegSetBits(SCPI_REG_ESR, errorESRBits(err));
+
+    //if (context) {
+    if (context.instrument->interface && context.instrument->interface->error) {
+        SCPI_Error(err);
+        //context.interface->error(err);
+    }
+
+    context.cmd_error = TRUE;
+    // }
+}
+
+/**
+ * Push error to queue from other than session thread. ESR is updated
+ * later by SCPI_RegSync on the session thread.
+ * @param err - error number
+ * @param info - detail text or NULL
+ * @param info_len - length of detail text
+ */
+void SCPICore::SCPI_ErrorPushAsync(int16_t err, const char * info, size_t info_len) {
+    scpi_error_t error;
+
+    errorFill(&error, err, info, info_len);
+    if (!fifo_add((fifo_t *)context.error_queue, &error)) {
+        err = SCPI_ERROR_QUEUE_OVERFLOW;
+    }
+    SCPI_RegSetBitsAsync(SCPI_REG_ESR, errorESRBits(err));
+}
+
+/**
+ * Fill queue entry
+ * @param error - entry to fill
+ * @param err - error number
+ * @param info - detail text or NULL
+ * @param info_len - length of detail text
+ */
+void SCPICore::errorFill(scpi_error_t * error, int16_t err, const char * info, size_t info_len) {
+    error->code = err;
+    error->info_len = 0;
+    if (info != NULL) {
+        error->info_len = min(info_len, sizeof (error->info));
+        memcpy(error->info, info, error->info_len);
+    }
+}
+
+const SCPICore::error_reg SCPICore::errs[ERROR_DEFS_N] = {
+    {-100, -199, ESR_CER}, /* Command error (e.g. syntax error) ch 21.8.9    */
+    {-200, -299, ESR_EER}, /* Execution Error (e.g. range error) ch 21.8.10  */
+    {-300, -399, ESR_DER}, /* Device specific error -300, -399 ch 21.8.11    */
+    {-400, -499, ESR_QER}, /* Query error -400, -499 ch 21.8.12              */
+    {-500, -599, ESR_PON}, /* Power on event -500, -599 ch 21.8.13           */
+    {-600, -699, ESR_URQ}, /* User Request Event -600, -699 ch 21.8.14       */
+    {-700, -799, ESR_REQ}, /* Request Control Event -700, -799 ch 21.8.15    */
+    {-800, -899, ESR_OPC}, /* Operation Complete Event -800, -899 ch 21.8.16 */
+};
+
+/**
+ * Get ESR bits belonging to error number
+ * @param err - error number
+ * @return ESR bits
+ */
+scpi_reg_val_t SCPICore::errorESRBits(int16_t err) {
+    scpi_reg_val_t bits = 0;
+    int i;
+
+    for(i = 0; i < ERROR_DEFS_N; i++) {
+        if ((err <= errs[i].from) && (err >= errs[i].to)) {
+            bits |= errs[i].bit;
+        }
+    }
+    return bits;
+}
+
+/**
+ * Return number of errors/events in the queue
+ * @param context
+ * @return
+ */
+int32_t SCPICore::SCPI_ErrorCount()
+{
+    int16_t result = 0;
+
+    /*
+     * // FreeRTOS
+     * result = uxQueueMessagesWaiting((xQueueHandle)context.error_queue);
+     */
+
+    /* basic FIFO */
+    SCPI_RegSync();
+    fifo_count((fifo_t *)context.error_queue, &result);
+
+    return result;
+}
+
+/**
+ * Translate error number to string
+ * @param err - error number
+ * @return Error string representation
+ */
+const char *SCPICore::SCPI_ErrorTranslate(int16_t err)
+{
+    uint32_t i;
+    uint32_t mask = SCPI_ERROR_REGISTRY_SIZE - 1;
+    const scpi_error_def_t * registry = context.instrument->error_registry;
+
+    if (err == 0) {
+        return "No error";
+    }
+
+    for (i = (uint16_t)err & mask; registry[i].text != NULL; i = (i + 1) & mask) {
+        if (registry[i].code == err) {
+            return registry[i].text;
+        }
+    }
+
+    return "Unknown error";
+}
+
+/**
+ * Register error number and its text, existing text is replaced. Has to be
+ * done before the instrument is used by sessions.
+ * @param instrument - instrument definition
+ * @param err - error number
+ * @param text - error text
+ * @return FALSE if the registry is full
+ */
+scpi_bool_t SCPICore::SCPI_ErrorRegister(scpi_instrument_t * instrument, int16_t err, const char * text)
+{
+    uint32_t i;
+    uint32_t n;
+    uint32_t mask = SCPI_ERROR_REGISTRY_SIZE - 1;
+    scpi_error_def_t * registry = instrument->error_registry;
+
+    if (err == 0 || text == NULL) {
+        return FALSE;
+    }
+
+    /* keep at least one empty slot to terminate lookup */
+    for (i = (uint16_t)err & mask, n = 0; n < mask; i = (i + 1) & mask, n++) {
+        if (registry[i].text == NULL || registry[i].code == err) {
+            registry[i].code = err;
+            registry[i].text = text;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void SCPICore::SCPI_ErrorAddInternal(const scpi_error_t * error) {
+    /*
+     * // FreeRTOS
+     * xQueueSend((xQueueHandle)context.error_queue, error, 0);
+     */
+
+    /* basic FIFO */
+    if (!fifo_add((fifo_t *)context.error_queue, error) && (error->code != SCPI_ERROR_QUEUE_OVERFLOW)) {
+        SCPI_RegSetBits(SCPI_REG_ESR, errorESRBits(SCPI_ERROR_QUEUE_OVERFLOW));
+    }
+}
+
+
+
+
+/**
+ * Debug function: show current command and its parameters
+ * @param context
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_DebugCommand() {
+    size_t res;
+    printf("**DEBUG: %s (\"", context.paramlist.cmd->pattern);
+    res = fwrite(context.paramlist.parameters, 1, context.paramlist.length, stdout);
+    (void)res;
+    printf("\" - %lu\r\n", (unsigned long)context.paramlist.length);
+
+    return TRUE;
+}
+
+
+/**
+ * Initialize error queue
+ * @param fifo - queue with data and mask set by the session
+ */
+void SCPICore::fifo_init(fifo_t * fifo) {
+    uint32_t i;
+
+    for (i = 0; i <= fifo->mask; i++) {
+        fifo->data[i].seq.store(i, std::memory_order_relaxed);
+    }
+    fifo->rd = 0;
+    fifo->wr.store(0, std::memory_order_relaxed);
+    fifo->overflow.store(false, std::memory_order_relaxed);
+}
+
+/**
+ * Remove all values from queue, consumer side only
+ * @param fifo
+ */
+void SCPICore::fifo_clear(fifo_t * fifo) {
+    while (fifo_remove(fifo, NULL)) {
+    }
+    fifo->overflow.store(false, std::memory_order_release);
+}
+
+/**
+ * Add value to queue, can be called from any thread. Last slot of the queue
+ * is kept for Queue overflow: if the queue is full, value is dropped and
+ * overflow is reported by fifo_remove after all stored values.
+ * @param fifo
+ * @param value
+ * @return FALSE if the value was dropped
+ */
+scpi_bool_t SCPICore::fifo_add(fifo_t * fifo, const scpi_error_t * value) {
+    struct _fifo_slot_t * slot;
+    uint32_t pos;
+    uint32_t seq;
+
+    if (fifo->overflow.load(std::memory_order_acquire)) {
+        return FALSE;
+    }
+
+    pos = fifo->wr.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = &fifo->data[pos & fifo->mask];
+        seq = slot->seq.load(std::memory_order_acquire);
+        if (seq == pos) {
+            /* slot after this one stays free for Queue overflow */
+            seq = fifo->data[(pos + 1) & fifo->mask].seq.load(std::memory_order_acquire);
+            if (seq == pos + 1) {
+                if (fifo->wr.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if ((int32_t)(seq - (pos + 1)) < 0) {
+                fifo->overflow.store(true, std::memory_order_release);
+                return FALSE;
+            } else {
+                pos = fifo->wr.load(std::memory_order_relaxed);
+            }
+        } else if ((int32_t)(seq - pos) < 0) {
+            /* FIFO full */
+            fifo->overflow.store(true, std::memory_order_release);
+            return FALSE;
+        } else {
+            pos = fifo->wr.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->value.code = value->code;
+    slot->value.info_len = value->info_len;
+    memcpy(slot->value.info, value->info, value->info_len);
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    return TRUE;
+}
+
+/**
+ * Remove value from queue, consumer side only
+ * @param fifo
+ * @param value - removed value, Queue overflow after the last stored value
+ * if values were dropped
+ * @return FALSE if the queue is empty
+ */
+scpi_bool_t SCPICore::fifo_remove(fifo_t * fifo, scpi_error_t * value) {
+    struct _fifo_slot_t * slot = &fifo->data[fifo->rd & fifo->mask];
+    uint32_t seq = slot->seq.load(std::memory_order_acquire);
+
+    /* FIFO empty? Queue overflow goes after values still being added */
+    if (seq != fifo->rd + 1) {
+        if (fifo->wr.load(std::memory_order_acquire) == fifo->rd && fifo->overflow.exchange(false, std::memory_order_acq_rel)) {
+            if (value) {
+                value->code = SCPI_ERROR_QUEUE_OVERFLOW;
+                value->info_len = 0;
+            }
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    if (value) {
+        value->code = slot->value.code;
+        value->info_len = slot->value.info_len;
+        memcpy(value->info, slot->value.info, slot->value.info_len);
+    }
+
+    slot->seq.store(fifo->rd + fifo->mask + 1, std::memory_order_release);
+    fifo->rd++;
+
+    return TRUE;
+}
+
+/**
+ * Get next value without removing it, consumer side only
+ * @param fifo
+ * @param value - next value, Queue overflow after the last stored value
+ * if values were dropped
+ * @return FALSE if the queue is empty
+ */
+scpi_bool_t SCPICore::fifo_peek(fifo_t * fifo, scpi_error_t * value) {
+    struct _fifo_slot_t * slot = &fifo->data[fifo->rd & fifo->mask];
+    uint32_t seq = slot->seq.load(std::memory_order_acquire);
+
+    if (seq != fifo->rd + 1) {
+        if (fifo->wr.load(std::memory_order_acquire) == fifo->rd && fifo->overflow.load(std::memory_order_acquire)) {
+            value->code = SCPI_ERROR_QUEUE_OVERFLOW;
+            value->info_len = 0;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    value->code = slot->value.code;
+    value->info_len = slot->value.info_len;
+    memcpy(value->info, slot->value.info, slot->value.info_len);
+    return TRUE;
+}
+
+/**
+ * Get number of values in queue, consumer side only
+ * @param fifo
+ * @param value - number of values fifo_remove returns now, including Queue
+ * overflow, values still being added are not counted
+ * @return
+ */
+scpi_bool_t SCPICore::fifo_count(fifo_t * fifo, int16_t * value) {
+    uint32_t pos = fifo->rd;
+
+    while (pos - fifo->rd <= fifo->mask && fifo->data[pos & fifo->mask].seq.load(std::memory_order_acquire) == pos + 1) {
+        pos++;
+    }
+    *value = pos - fifo->rd;
+    if (fifo->wr.load(std::memory_order_acquire) == pos && fifo->overflow.load(std::memory_order_acquire)) {
+        *value += 1;
+    }
+    return TRUE;
+}
+
+
+
+/*
+ * multipliers IEEE 488.2-1992 tab 7-2
+ * 1E18         EX
+ * 1E15         PE
+ * 1E12         T
+ * 1E9          G
+ * 1E6          MA (use M for OHM and HZ)
+ * 1E3          K
+ * 1E-3         M (disaalowed for OHM and HZ)
+ * 1E-6         U
+ * 1E-9         N
+ * 1E-12        P
+ * 1E-15        F
+ * 1E-18        A
+ */
+
+/*
+ * units definition IEEE 488.2-1992 tab 7-1
+ */
+const scpi_unit_def_t SCPICore::scpi_units_def[] = {
+    /* voltage */
+    {/* name */ "UV",   /* unit */ SCPI_UNIT_VOLT,      /* mult */ SCPI_MULT(1e-6, 1, -6)},
+    {/* name */ "MV",   /* unit */ SCPI_UNIT_VOLT,      /* mult */ SCPI_MULT(1e-3, 1, -3)},
+    {/* name */ "V",    /* unit */ SCPI_UNIT_VOLT,      /* mult */ SCPI_MULT(1, 1, 0)},
+    {/* name */ "KV",   /* unit */ SCPI_UNIT_VOLT,      /* mult */ SCPI_MULT(1e3, 1, 3)},
+
+    /* current */
+    {/* name */ "UA",   /* unit */ SCPI_UNIT_AMPER,     /* mult */ SCPI_MULT(1e-6, 1, -6)},
+    {/* name */ "MA",   /* unit */ SCPI_UNIT_AMPER,     /* mult */ SCPI_MULT(1e-3, 1, -3)},
+    {/* name */ "A",    /* unit */ SCPI_UNIT_AMPER,     /* mult */ SCPI_MULT(1, 1, 0)},
+    {/* name */ "KA",   /* unit */ SCPI_UNIT_AMPER,     /* mult */ SCPI_MULT(1e3, 1, 3)},
+
+    /* resistance */
+    {/* name */ "OHM",  /* unit */ SCPI_UNIT_OHM,       /* mult */ SCPI_MULT(1, 1, 0)},
+    {/* name */ "KOHM", /* unit */ SCPI_UNIT_OHM,       /* mult */ SCPI_MULT(1e3, 1, 3)},
+    {/* name */ "MOHM", /* unit */ SCPI_UNIT_OHM,       /* mult */ SCPI_MULT(1e6, 1, 6)},
+
+    /* frequency */
+    {/* name */ "HZ",   /* unit */ SCPI_UNIT_HERTZ,     /* mult */ SCPI_MULT(1, 1, 0)},
+    {/* name */ "KHZ",  /* unit */ SCPI_UNIT_HERTZ,     /* mult */ SCPI_MULT(1e3, 1, 3)},
+    {/* name */ "MHZ",  /* unit */ SCPI_UNIT_HERTZ,     /* mult */ SCPI_MULT(1e6, 1, 6)},
+    {/* name */ "GHZ",  /* unit */ SCPI_UNIT_HERTZ,     /* mult */ SCPI_MULT(1e9, 1, 9)},
+
+    /* temperature */
+    {/* name */ "CEL",  /* unit */ SCPI_UNIT_CELSIUS,   /* mult */ SCPI_MULT(1, 1, 0)},
+
+    /* time */
+    {/* name */ "PS",   /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(1e-12, 1, -12)},
+    {/* name */ "NS",   /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(1e-9, 1, -9)},
+    {/* name */ "US",   /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(1e-6, 1, -6)},
+    {/* name */ "MS",   /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(1e-3, 1, -3)},
+    {/* name */ "S",    /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(1, 1, 0)},
+    {/* name */ "MIN",  /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(60, 6, 1)},
+    {/* name */ "HR",   /* unit */ SCPI_UNIT_SECONDS,   /* mult */ SCPI_MULT(3600, 36, 2)},
+
+    SCPI_UNITS_LIST_END,
+};
+
+/*
+ * Special number values definition
+ */
+const scpi_special_number_def_t SCPICore::scpi_special_numbers_def[] = {
+    {/* name */ "MINimum",      /* type */ SCPI_NUM_MIN},
+    {/* name */ "MAXimum",      /* type */ SCPI_NUM_MAX},
+    {/* name */ "DEFault",      /* type */ SCPI_NUM_DEF},
+    {/* name */ "UP",           /* type */ SCPI_NUM_UP},
+    {/* name */ "DOWN",         /* type */ SCPI_NUM_DOWN},
+    {/* name */ "NAN",          /* type */ SCPI_NUM_NAN},
+    {/* name */ "INFinity",     /* type */ SCPI_NUM_INF},
+    {/* name */ "NINF",         /* type */ SCPI_NUM_NINF},
+    SCPI_SPECIAL_NUMBERS_LIST_END,
+};
+
+/**
+ * Match string constant to one of special number values
+ * @param specs specifications of special numbers (patterns)
+ * @param str string to be recognised
+ * @param len length of string
+ * @param value resultin value
+ * @return TRUE if str matches one of specs patterns
+ */
+scpi_bool_t SCPICore::translateSpecialNumber(const scpi_special_number_def_t * specs, const char * str, size_t len, scpi_number_t * value) {
+    int i;
+
+#if SCPI_USE_FIXED_POINT
+    value->value.mantissa = 0;
+    value->value.exponent = 0;
+#else
+    value->value = 0.0;
+#endif
+    value->unit = SCPI_UNIT_NONE;
+    value->type = SCPI_NUM_NUMBER;
+
+    if (specs == NULL) {
+        return FALSE;
+    }
+
+    for (i = 0; specs[i].name != NULL; i++) {
+        if (matchPattern(specs[i].name, strlen(specs[i].name), str, len)) {
+            value->type = specs[i].type;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/**
+ * Convert special number type to its string representation
+ * @param specs specifications of special numbers (patterns)
+ * @param type type of special number
+ * @return String representing special number or NULL
+ */
+const char * SCPICore::translateSpecialNumberInverse(const scpi_special_number_def_t * specs, scpi_special_number_t type) {
+    int i;
+
+    if (specs == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; specs[i].name != NULL; i++) {
+        if (specs[i].type == type) {
+            return specs[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Convert string describing unit to its representation
+ * @param units units patterns
+ * @param unit text representation of unknown unit
+ * @param len length of text representation
+ * @return pointer of related unit definition or NULL
+ */
+const scpi_unit_def_t * SCPICore::translateUnit(const scpi_unit_def_t * units, const char * unit, size_t len) {
+    int i;
+
+    if (units == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; units[i].name != NULL; i++) {
+        if (compareStr(unit, len, units[i].name, strlen(units[i].name))) {
+            return &units[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Convert unit definition to string
+ * @param units units definitions (patterns)
+ * @param unit type of unit
+ * @return string representation of unit
+ */
+const char * SCPICore::translateUnitInverse(const scpi_unit_def_t * units, const scpi_unit_t unit) {
+    int i;
+
+    if (units == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; units[i].name != NULL; i++) {
+#if SCPI_USE_FIXED_POINT
+        if ((units[i].unit == unit) && (units[i].mult.mantissa == 1) && (units[i].mult.exponent == 0)) {
+#else
+        if ((units[i].unit == unit) && (units[i].mult == 1)) {
+#endif
+            return units[i].name;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Transform number to base units
+ * @param context
+ * @param unit text representation of unit
+ * @param len length of text representation
+ * @param value preparsed numeric value
+ * @return TRUE if value parameter was converted to base units
+ */
+scpi_bool_t SCPICore::transformNumber(const char * unit, size_t len, scpi_number_t * value) {
+    size_t s;
+    const scpi_unit_def_t * unitDef;
+    s = skipWhitespace(unit, len);
+
+    if (s == len) {
+        value->unit = SCPI_UNIT_NONE;
+        return TRUE;
+    }
+
+    unitDef = translateUnit(context.instrument->units, unit + s, len - s);
+
+    if (unitDef == NULL) {
+        SCPI_ErrorPush(SCPI_ERROR_INVALID_SUFFIX);
+        return FALSE;
+    }
+
+#if SCPI_USE_FIXED_POINT
+    /* least significant digits are dropped if the product does not fit */
+    {
+        int64_t limit = INT64_MAX / ((unitDef->mult.mantissa < 0) ? -unitDef->mult.mantissa : unitDef->mult.mantissa);
+        while ((value->value.mantissa > limit) || (value->value.mantissa < -limit)) {
+            value->value.mantissa /= 10;
+            value->value.exponent++;
+        }
+        value->value.mantissa *= unitDef->mult.mantissa;
+        value->value.exponent += unitDef->mult.exponent;
+    }
+#else
+    value->value *= unitDef->mult;
+#endif
+    value->unit = unitDef->unit;
+
+    return TRUE;
+}
+
+/**
+ * Parse parameter as number, number with unit or special value (min, max, default, ...)
+ * @param context
+ * @param value return value
+ * @param mandatory if the parameter is mandatory
+ * @return
+ */
+scpi_bool_t SCPICore::SCPI_ParamNumber(scpi_number_t * value, scpi_bool_t mandatory) {
+    scpi_bool_t result;
+    const char * param;
+    size_t len;
+    size_t numlen;
+
+    /* read parameter and shift to the next one */
+    result = SCPI_ParamString(&param, &len, mandatory);
+
+    /* value not initializes */
+    if (!value) {
+        return FALSE;
+    }
+
+    value->type = SCPI_NUM_DEF;
+
+    /* if parameter was not found, return TRUE or FALSE according
+     * to fact that parameter was mandatory or not */
+    if (!result) {
+        return mandatory ? FALSE : TRUE;
+    }
+
+    /* convert string to special number type */
+    if (translateSpecialNumber(context.instrument->special_numbers, param, len, value)) {
+        /* found special type */
+        return TRUE;
+    }
+
+    /* convert text from number - no special type */
+#if SCPI_USE_FIXED_POINT
+    numlen = strToDecimal(param, &value->value.mantissa, &value->value.exponent);
+#else
+    numlen = strToDouble(param, &value->value);
+#endif
+
+    /* transform units of value */
+    if (numlen <= len) {
+        return transformNumber(param + numlen, len - numlen, value);
+    }
+    return FALSE;
+
+}
+
+/**
+ * Convert scpi_number_t to string
+ * @param context
+ * @param value number value
+ * @param str target string
+ * @param len max length of string
+ * @return number of chars written to string
+ */
+size_t SCPICore::SCPI_NumberToStr(scpi_number_t * value, char * str, size_t len) {
+    const char * type;
+    const char * unit;
+    size_t result;
+
+    if (!value || !str) {
+        return 0;
+    }
+
+    type = translateSpecialNumberInverse(context.instrument->special_numbers, value->type);
+
+    if (type) {
+        strncpy(str, type, len);
+        return min(strlen(type), len);
+    }
+
+#if SCPI_USE_FIXED_POINT
+    result = decimalToStr(value->value.mantissa, value->value.exponent, str, len);
+#else
+    result = doubleToStr(value->value, str, len);
+#endif
+
+    unit = translateUnitInverse(context.instrument->units, value->unit);
+
+    if (unit) {
+        strncat(str, " ", len);
+        strncat(str, unit, len);
+        result += strlen(unit) + 1;
+    }
+
+    return result;
+}
+
+
+/*
+ * Status register groups, ordered from leaves to STB. Summaries are
+ * propagated in one pass in this order. Device specific groups are
+ * listed first, e.g.
+ * #define SCPI_USER_REG_GROUPS {SCPI_REG_VOLTC, ..., SCPI_REG_QUESC, 0x0001},
+ */
+const scpi_reg_group_t SCPICore::scpi_reg_groups[] = {
+#ifdef SCPI_USER_REG_GROUPS
+    SCPI_USER_REG_GROUPS
+#endif
+    {/* condition */ SCPI_REG_OPERC, /* ptr */ SCPI_REG_OPERPTR, /* ntr */ SCPI_REG_OPERNTR,
+     /* event */ SCPI_REG_OPER, /* enable */ SCPI_REG_OPERE, /* parent */ SCPI_REG_STB, /* parent_bit */ STB_OPS},
+    {/* condition */ SCPI_REG_QUESC, /* ptr */ SCPI_REG_QUESPTR, /* ntr */ SCPI_REG_QUESNTR,
+     /* event */ SCPI_REG_QUES, /* enable */ SCPI_REG_QUESE, /* parent */ SCPI_REG_STB, /* parent_bit */ STB_QES},
+    {/* condition */ SCPI_REG_COUNT, /* ptr */ SCPI_REG_COUNT, /* ntr */ SCPI_REG_COUNT,
+     /* event */ SCPI_REG_ESR, /* enable */ SCPI_REG_ESE, /* parent */ SCPI_REG_STB, /* parent_bit */ STB_ESR},
+    SCPI_REG_GROUPS_LIST_END,
+};
+
+/**
+ * Reset all registers, transition filters to SCPI defaults
+ */
+void SCPICore::SCPI_RegInit() {
+    const scpi_reg_group_t * group;
+    int i;
+
+    if (context.registers == NULL) {
+        return;
+    }
+
+    memset(context.registers, 0, SCPI_REG_COUNT * sizeof (scpi_reg_val_t));
+    for (group = context.instrument->reg_groups; group->event != SCPI_REG_COUNT; group++) {
+        if (group->ptr != SCPI_REG_COUNT) {
+            context.registers[group->ptr] = 0x7FFF;
+        }
+    }
+
+    for (i = 0; i < SCPI_REG_COUNT; i++) {
+        scpi_regs_async.condition[i].store(0, std::memory_order_relaxed);
+        scpi_regs_async.raised[i].store(0, std::memory_order_relaxed);
+        scpi_regs_async.lowered[i].store(0, std::memory_order_relaxed);
+    }
+    scpi_regs_async.dirty.store(false, std::memory_order_release);
+}
+
+/**
+ * Set register bits from other than session thread. Can be called at high
+ * rate, changes are applied by SCPI_RegSync in one batch.
+ * @param name - register name
+ * @param bits bit mask
+ */
+void SCPICore::SCPI_RegSetBitsAsync(scpi_reg_name_t name, scpi_reg_val_t bits) {
+    scpi_reg_val_t old_val;
+
+    if (name >= SCPI_REG_COUNT) {
+        return;
+    }
+
+    if (regGroupByCondition(name) != NULL) {
+        old_val = scpi_regs_async.condition[name].fetch_or(bits, std::memory_order_acq_rel);
+        bits &= ~old_val;
+    }
+
+    if (bits) {
+        scpi_regs_async.raised[name].fetch_or(bits, std::memory_order_release);
+        scpi_regs_async.dirty.store(true, std::memory_order_release);
+    }
+}
+
+/**
+ * Clear register bits from other than session thread. Can be called at high
+ * rate, changes are applied by SCPI_RegSync in one batch.
+ * @param name - register name
+ * @param bits bit mask
+ */
+void SCPICore::SCPI_RegClearBitsAsync(scpi_reg_name_t name, scpi_reg_val_t bits) {
+    scpi_reg_val_t old_val;
+
+    if (name >= SCPI_REG_COUNT) {
+        return;
+    }
+
+    if (regGroupByCondition(name) != NULL) {
+        old_val = scpi_regs_async.condition[name].fetch_and(~bits, std::memory_order_acq_rel);
+        bits &= old_val;
+    }
+
+    if (bits) {
+        scpi_regs_async.lowered[name].fetch_or(bits, std::memory_order_release);
+        scpi_regs_async.dirty.store(true, std::memory_order_release);
+    }
+}
+
+/**
+ * Apply register changes made by other threads and update STB once.
+ * Transitions of condition registers are latched exactly, even if the bit
+ * returned back before the batch was applied. For other registers set bits
+ * win over cleared bits of the same batch.
+ */
+void SCPICore::SCPI_RegSync() {
+    scpi_reg_val_t * regs = context.registers;
+    const scpi_reg_group_t * group;
+    scpi_reg_val_t raised;
+    scpi_reg_val_t lowered;
+    int i;
+
+    if (regs == NULL || !scpi_regs_async.dirty.load(std::memory_order_acquire)) {
+        return;
+    }
+    scpi_regs_async.dirty.store(false, std::memory_order_relaxed);
+
+    for (i = 0; i < SCPI_REG_COUNT; i++) {
+        if (scpi_regs_async.raised[i].load(std::memory_order_relaxed) == 0
+                && scpi_regs_async.lowered[i].load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        raised = scpi_regs_async.raised[i].exchange(0, std::memory_order_acq_rel);
+        lowered = scpi_regs_async.lowered[i].exchange(0, std::memory_order_acq_rel);
+
+        group = regGroupByCondition((scpi_reg_name_t) i);
+        if (group != NULL) {
+            regs[i] = scpi_regs_async.condition[i].load(std::memory_order_acquire);
+            regs[group->event] |= regTransitions(group, raised, lowered);
+        } else {
+            regs[i] = (regs[i] & ~lowered) | raised;
+        }
+    }
+
+    regUpdate();
+}
+
+/**
+ * Find register group by its condition, event or enable register
+ * @param name - register name
+ * @return group or NULL if the register is in no group
+ */
+const scpi_reg_group_t * SCPICore::regGroup(scpi_reg_name_t name) {
+    uint8_t i;
+
+    if (name >= SCPI_REG_COUNT) {
+        return NULL;
+    }
+    i = context.instrument->reg_group[name];
+    return (i != SCPI_REG_GROUP_NONE) ? &context.instrument->reg_groups[i] : NULL;
+}
+
+/**
+ * Find register group by its condition register
+ * @param name - register name
+ * @return group or NULL if name is not condition register
+ */
+const scpi_reg_group_t * SCPICore::regGroupByCondition(scpi_reg_name_t name) {
+    const scpi_reg_group_t * group = regGroup(name);
+
+    return (group != NULL && group->condition == name) ? group : NULL;
+}
+
+/**
+ * Change bits of condition register and latch their transitions to event
+ * register. Other bits are kept, even if SCPI_RegSetBitsAsync changes them
+ * meanwhile, their transitions are latched by SCPI_RegSync.
+ * @param group - register group
+ * @param set - bits to set
+ * @param clear - bits to clear
+ */
+void SCPICore::regSetCondition(const scpi_reg_group_t * group, scpi_reg_val_t set, scpi_reg_val_t clear) {
+    scpi_reg_val_t * regs = context.registers;
+    std::atomic<scpi_reg_val_t> * condition = &scpi_regs_async.condition[group->condition];
+    scpi_reg_val_t old_val = condition->load(std::memory_order_relaxed);
+    scpi_reg_val_t val;
+
+    do {
+        val = (old_val & ~clear) | set;
+    } while (!condition->compare_exchange_weak(old_val, val, std::memory_order_acq_rel));
+
+    regs[group->condition] = val;
+    regs[group->event] |= regTransitions(group, ~old_val & val, old_val & ~val);
+}
+
+/**
+ * Filter transitions of condition register by PTR and NTR of the group
+ * @param group - register group
+ * @param raised - condition bits changed from 0 to 1
+ * @param lowered - condition bits changed from 1 to 0
+ * @return bits latched to event register
+ */
+scpi_reg_val_t SCPICore::regTransitions(const scpi_reg_group_t * group, scpi_reg_val_t raised, scpi_reg_val_t lowered) {
+    scpi_reg_val_t * regs = context.registers;
+    scpi_reg_val_t result = raised;
+
+    if (group->ptr != SCPI_REG_COUNT) {
+        result &= regs[group->ptr];
+    }
+    if (group->ntr != SCPI_REG_COUNT) {
+        result |= lowered & regs[group->ntr];
+    }
+    return result;
+}
+
+/**
+ * Propagate summaries of all register groups to STB in one pass and
+ * request service if new enabled STB bit appeared
+ */
+void SCPICore::regUpdate() {
+    scpi_reg_val_t * regs = context.registers;
+    const scpi_reg_group_t * group;
+    const scpi_reg_group_t * parent;
+    scpi_reg_val_t old_stb = regs[SCPI_REG_STB];
+    scpi_reg_val_t bit;
+
+    for (group = context.instrument->reg_groups; group->event != SCPI_REG_COUNT; group++) {
+        bit = (group->enable != SCPI_REG_COUNT && (regs[group->event] & regs[group->enable])) ? group->parent_bit : 0;
+
+        parent = regGroupByCondition(group->parent);
+        if (parent != NULL) {
+            /* only the summary bit, asynchronous changes of other bits stay */
+            regSetCondition(parent, bit, group->parent_bit & ~bit);
+        } else {
+            regs[group->parent] = (regs[group->parent] & ~group->parent_bit) | bit;
+        }
+    }
+
+    regStatus(old_stb);
+}
+
+/**
+ * Propagate summary of one register group towards STB. Stops at the first
+ * summary bit which does not change.
+ * @param group - group with changed register
+ */
+void SCPICore::regPropagate(const scpi_reg_group_t * group) {
+    scpi_reg_val_t * regs = context.registers;
+    const scpi_reg_group_t * parent;
+    scpi_reg_val_t bit;
+
+    while (group != NULL) {
+        bit = (group->enable != SCPI_REG_COUNT && (regs[group->event] & regs[group->enable])) ? group->parent_bit : 0;
+        if ((regs[group->parent] & group->parent_bit) == bit) {
+            return;
+        }
+
+        parent = regGroupByCondition(group->parent);
+        if (parent != NULL) {
+            regSetCondition(parent, bit, group->parent_bit & ~bit);
+        } else {
+            regs[group->parent] = (regs[group->parent] & ~group->parent_bit) | bit;
+        }
+        group = parent;
+    }
+}
+
+/**
+ * Set SRQ bit of STB by SRE, request service if new enabled STB bit
+ * appeared and notify subscribers if STB changed
+ * @param old_stb - STB before the change
+ */
+void SCPICore::regStatus(scpi_reg_val_t old_stb) {
+    scpi_reg_val_t * regs = context.registers;
+    scpi_reg_val_t stb = regs[SCPI_REG_STB] & ~STB_SRQ;
+    scpi_reg_val_t mask = regs[SCPI_REG_SRE] & ~STB_SRQ;
+
+    if (stb & mask) {
+        stb |= STB_SRQ;
+    }
+    regs[SCPI_REG_STB] = stb;
+
+    /* request service only for new reason */
+    if (stb & mask & ~old_stb) {
+        writeControl(SCPI_CTRL_SRQ, stb);
+        statusNotify(stb ^ old_stb, TRUE);
+    } else if (stb != old_stb) {
+        statusNotify(stb ^ old_stb, FALSE);
+    }
+}
+
+/**
+ * Subscribe for status changes
+ * @param callback - called with current STB and changed STB bits
+ * @param user_context - value passed to callback
+ * @param mask - STB bits of interest, STB_SRQ for service requests
+ * @return subscription id or -1 if there is no free slot
+ */
+int SCPICore::SCPI_StatusSubscribe(scpi_status_callback_t callback, void * user_context, scpi_reg_val_t mask) {
+    int i;
+
+    for (i = 0; i < SCPI_STATUS_SUBSCRIBERS; i++) {
+        scpi_status_subscriber_t * sub = &scpi_status.subscribers[i];
+        if (sub->callback == NULL && sub->fd < 0) {
+            sub->callback = callback;
+            sub->user_context = user_context;
+            sub->mask = mask;
+            scpi_status.mask |= mask;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Subscribe for status changes with file descriptor. On change, 8 byte
+ * value 1 is written to fd, so it can be eventfd or pipe watched by the
+ * transport event loop.
+ * @param fd - file descriptor
+ * @param mask - STB bits of interest, STB_SRQ for service requests
+ * @return subscription id or -1 if there is no free slot
+ */
+int SCPICore::SCPI_StatusSubscribeFd(int fd, scpi_reg_val_t mask) {
+    int i;
+
+    for (i = 0; i < SCPI_STATUS_SUBSCRIBERS; i++) {
+        scpi_status_subscriber_t * sub = &scpi_status.subscribers[i];
+        if (sub->callback == NULL && sub->fd < 0) {
+            sub->fd = fd;
+            sub->mask = mask;
+            scpi_status.mask |= mask;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Cancel subscription
+ * @param id - subscription id
+ */
+void SCPICore::SCPI_StatusUnsubscribe(int id) {
+    int i;
+
+    if (id < 0 || id >= SCPI_STATUS_SUBSCRIBERS) {
+        return;
+    }
+    scpi_status.subscribers[id].callback = NULL;
+    scpi_status.subscribers[id].user_context = NULL;
+    scpi_status.subscribers[id].fd = -1;
+    scpi_status.subscribers[id].mask = 0;
+
+    scpi_status.mask = 0;
+    for (i = 0; i < SCPI_STATUS_SUBSCRIBERS; i++) {
+        scpi_status.mask |= scpi_status.subscribers[i].mask;
+    }
+}
+
+/**
+ * Set coalescing window. First change is delivered at once, changes within
+ * the window after it are delivered together by SCPI_StatusDispatch.
+ * @param window - window length in ms, 0 to deliver each change immediately
+ */
+void SCPICore::SCPI_StatusWindow(uint32_t window) {
+    scpi_status.window = window;
+}
+
+/**
+ * Set clock of the coalescing window, e.g. time of the transport event
+ * loop or a simulated time
+ * @param clock - returns time in ms, wraps around, NULL for steady clock
+ */
+void SCPICore::SCPI_StatusClock(uint32_t (*clock)()) {
+    scpi_status.clock = (clock != NULL) ? clock : statusClock;
+}
+
+/**
+ * Deliver coalesced status changes if the window closed. If window is not
+ * 0, the transport event loop calls it after input was processed and then
+ * again after the returned time, e.g. as timeout of epoll_wait.
+ * @return ms until changes waiting for delivery are due, -1 if there are
+ * none
+ */
+int32_t SCPICore::SCPI_StatusDispatch() {
+    uint32_t elapsed;
+
+    SCPI_OperationSync();
+    SCPI_RegSync();
+
+    if (scpi_status.changed == 0 && !scpi_status.srq) {
+        return -1;
+    }
+
+    elapsed = scpi_status.clock() - scpi_status.last;
+    if (elapsed < scpi_status.window) {
+        return scpi_status.window - elapsed;
+    }
+
+    scpi_status.last += elapsed;
+    statusDeliver();
+    return -1;
+}
+
+/**
+ * Monotonic time of status coalescing
+ * @return time in ms, wraps around
+ */
+uint32_t SCPICore::statusClock() {
+    return (uint32_t) std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * Record status change for subscribers. Delivered at once if no change
+ * was delivered within the window, otherwise by SCPI_StatusDispatch.
+ * @param changed - changed STB bits
+ * @param srq - service was requested
+ */
+void SCPICore::statusNotify(scpi_reg_val_t changed, scpi_bool_t srq) {
+    uint32_t now;
+
+    /* no subscriber is interested, nothing waits for the window */
+    if (!srq && scpi_status.window == 0 && scpi_status.changed == 0 && !(changed & scpi_status.mask)) {
+        statusSignal(context.registers[SCPI_REG_STB], changed, false);
+        return;
+    }
+
+    scpi_status.changed |= changed;
+    if (srq) {
+        scpi_status.srq = TRUE;
+    }
+
+    if (scpi_status.window == 0) {
+        statusDeliver();
+        return;
+    }
+
+    now = scpi_status.clock();
+    if ((uint32_t)(now - scpi_status.last) >= scpi_status.window) {
+        /* leading edge, window starts now */
+        scpi_status.last = now;
+        statusDeliver();
+    }
+}
+
+/**
+ * Deliver recorded status changes to all subscribers
+ */
+void SCPICore::statusDeliver() {
+    scpi_reg_val_t stb = context.registers ? context.registers[SCPI_REG_STB] : 0;
+    scpi_reg_val_t changed = scpi_status.changed;
+    scpi_bool_t srq = scpi_status.srq;
+    int i;
+
+    scpi_status.changed = 0;
+    scpi_status.srq = FALSE;
+
+    for (i = 0; i < SCPI_STATUS_SUBSCRIBERS && ((changed & scpi_status.mask) || srq); i++) {
+        scpi_status_subscriber_t * sub = &scpi_status.subscribers[i];
+        if (!(changed & sub->mask) && !(srq && (sub->mask & STB_SRQ))) {
+            continue;
+        }
+        if (sub->callback != NULL) {
+            sub->callback(sub->user_context, stb, changed);
+        }
+#if defined(__unix__)
+        if (sub->fd >= 0) {
+            uint64_t one = 1;
+            ssize_t res = write(sub->fd, &one, sizeof (one));
+            (void) res;
+        }
+#endif
+    }
+
+    statusSignal(stb, changed, srq);
+}
+
+/**
+ * Status change delivered to subclass (Qt signals of SCPIParser)
+ * @param stb - status byte
+ * @param changed - changed bits
+ * @param srq - service request was generated
+ */
+void SCPICore::statusSignal(int stb, int changed, bool srq) {
+    (void) stb;
+    (void) changed;
+    (void) srq;
+}
+
+/**
+ * Get register value
+ * @param name - register name
+ * @return register value
+ */
+scpi_reg_val_t SCPICore::SCPI_RegGet(scpi_reg_name_t name) {
+    SCPI_RegSync();
+    if ((name < SCPI_REG_COUNT) && (context.registers != NULL)) {
+        return context.registers[name];
+    } else {
+        return 0;
+    }
+}
+
+/**
+ * Wrapper function to control interface from context
+ * @param context
+ * @param ctrl number of controll message
+ * @param value value of related register
+ */
+size_t SCPICore::writeControl(scpi_ctrl_name_t ctrl, scpi_reg_val_t val) {
+    if (context.instrument->interface && context.instrument->interface->control) {
+        return SCPI_Control(ctrl, val);
+        //return context.interface->control(ctrl, val);
+    } else {
+        return 0;
+    }
+}
+
+
+
+/**
+ * Set register value. Transitions of condition register are latched to its
+ * event register and STB is updated.
+ * @param name - register name
+ * @param val - new value
+ */
+void SCPICore::SCPI_RegSet(scpi_reg_name_t name, scpi_reg_val_t val) {
+    regWrite(name, val, (scpi_reg_val_t) ~val);
+}
+
+/**
+ * Set register bits
+ * @param name - register name
+ * @param bits bit mask
+ */
+void SCPICore::SCPI_RegSetBits(scpi_reg_name_t name, scpi_reg_val_t bits) {
+    regWrite(name, bits, 0);
+}
+
+/**
+ * Clear register bits
+ * @param name - register name
+ * @param bits bit mask
+ */
+void SCPICore::SCPI_RegClearBits(scpi_reg_name_t name, scpi_reg_val_t bits) {
+    regWrite(name, 0, bits);
+}
+
+/**
+ * Change register bits and update STB. Only given bits of condition
+ * register are written, bits changed asynchronously meanwhile stay.
+ * @param name - register name
+ * @param set - bits to set
+ * @param clear - bits to clear
+ */
+void SCPICore::regWrite(scpi_reg_name_t name, scpi_reg_val_t set, scpi_reg_val_t clear) {
+    scpi_reg_val_t * regs = context.registers;
+    const scpi_reg_group_t * group;
+    scpi_reg_val_t old_stb;
+
+    if (scpi_regs_async.dirty.load(std::memory_order_acquire)) {
+        SCPI_RegSync();
+    }
+    if ((name >= SCPI_REG_COUNT) || (regs == NULL)) {
+        return;
+    }
+
+    old_stb = regs[SCPI_REG_STB];
+    group = regGroup(name);
+    if (group != NULL && group->condition == name) {
+        regSetCondition(group, set, clear);
+    } else {
+        regs[name] = (regs[name] & ~clear) | set;
+    }
+
+    if (group != NULL) {
+        regPropagate(group);
+    }
+    regStatus(old_stb);
+}
+
+/**
+ * Clear event register
+ * @param context
+ */
+void SCPICore::SCPI_EventClear() {
+    const scpi_reg_group_t * group;
+
+    if (context.registers == NULL) {
+        return;
+    }
+
+    for (group = context.instrument->reg_groups; group->event != SCPI_REG_COUNT; group++) {
+        context.registers[group->event] = 0;
+    }
+    regUpdate();
+}
+
+/**
+ * *CLS - This command clears all status data structures in a device.
+ *        For a device which minimally complies with SCPI. (SCPI std 4.1.3.2)
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreCls() {
+    /* operation complete command idle state */
+    scpi_operations.opc = FALSE;
+    SCPI_ErrorClear();
+    SCPI_EventClear();
+    return SCPI_RES_OK;
+}
+
+/**
+ * *ESE
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreEse() {
+    int32_t new_ESE;
+    if (SCPI_ParamInt(&new_ESE, TRUE)) {
+        SCPI_RegSet(SCPI_REG_ESE, new_ESE);
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *ESE?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreEseQ() {
+    SCPI_ResultInt(SCPI_RegGet(SCPI_REG_ESE));
+    return SCPI_RES_OK;
+}
+
+/**
+ * *ESR?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreEsrQ() {
+    SCPI_ResultInt(SCPI_RegGet(SCPI_REG_ESR));
+    SCPI_RegSet(SCPI_REG_ESR, 0);
+    return SCPI_RES_OK;
+}
+
+/**
+ * *IDN?
+ *
+ * field1: MANUFACTURE
+ * field2: MODEL
+ * field4: SUBSYSTEMS REVISIONS
+ *
+ * example: MANUFACTURE,MODEL,0,01-02-01
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreIdnQ() {
+    SCPI_ResultString(context.instrument->idn[0]);
+    SCPI_ResultString(context.instrument->idn[1]);
+    SCPI_ResultString(context.instrument->idn[2]);
+    SCPI_ResultString(context.instrument->idn[3]);
+    return SCPI_RES_OK;
+}
+
+/**
+ * *OPC
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreOpc() {
+    SCPI_OperationSync();
+    if (scpi_operations.pending == 0) {
+        SCPI_RegSetBits(SCPI_REG_ESR, ESR_OPC);
+    } else {
+        scpi_operations.opc = TRUE;
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *OPC?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreOpcQ() {
+    SCPI_OperationSync();
+    if (scpi_operations.pending == 0) {
+        SCPI_ResultInt(1);
+    } else {
+        /* result is written when all operations complete */
+        scpi_operations.opcq = TRUE;
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *RST
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreRst() {
+    if (context.instrument->interface && context.instrument->interface->reset) {
+        return SCPI_Reset();
+        //return context.interface->reset(context);
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *SRE
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreSre() {
+    int32_t new_SRE;
+    if (SCPI_ParamInt(&new_SRE, TRUE)) {
+        SCPI_RegSet(SCPI_REG_SRE, new_SRE);
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *SRE?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreSreQ() {
+    SCPI_ResultInt(SCPI_RegGet(SCPI_REG_SRE));
+    return SCPI_RES_OK;
+}
+
+/**
+ * *STB?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreStbQ() {
+    SCPI_ResultInt(SCPI_RegGet(SCPI_REG_STB));
+    return SCPI_RES_OK;
+}
+
+/**
+ * *TST?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreTstQ() {
+    int result = 0;
+    if (context.instrument->interface && context.instrument->interface->test) {
+        result=SCPI_Test();
+        //result = context.interface->test(context);
+    }
+    SCPI_ResultInt(result);
+    return SCPI_RES_OK;
+}
+
+/**
+ * SYSTem:ERRor[:NEXT]?
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_SystemErrorNextQ() {
+    scpi_error_t error;
+
+    SCPI_ErrorPopEx(&error);
+    SCPI_ResultError(&error);
+    return SCPI_RES_OK;
+}
+
+/**
+ * SYSTem:ERRor:ALL?
+ * Pops errors as long as they fit into the output queue, the rest is
+ * returned by the next query.
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_SystemErrorAllQ() {
+    scpi_error_t error;
+
+    SCPI_ErrorPopEx(&error);
+    SCPI_ResultError(&error);
+
+    /* entries which do not fit into output queue stay queued */
+    while (SCPI_ErrorPeekEx(&error)) {
+        if (context.output.data != NULL
+                && resultErrorLength(&error) + context.output.terminator_len > outputFree()) {
+            break;
+        }
+        SCPI_ErrorPopEx(&error);
+        SCPI_ResultError(&error);
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * *WAI
+ * @param context
+ * @return
+ */
+scpi_result_t SCPICore::SCPI_CoreWai() {
+    SCPI_OperationSync();
+    if (scpi_operations.pending != 0) {
+        /* following commands wait until all operations complete */
+        scpi_operations.wai = TRUE;
+    }
+    return SCPI_RES_OK;
+}
+
+/**
+ * Start overlapped operation. Command callback returns SCPI_RES_PENDING
+ * and the operation is finished later by SCPI_OperationComplete.
+ * @return completion token or -1 if too many operations are pending
+ */
+int SCPICore::SCPI_OperationBegin() {
+    int token;
+
+    SCPI_OperationSync();
+    for (token = 0; token < 32; token++) {
+        uint32_t bit = (uint32_t)1 << token;
+        if (!(scpi_operations.pending & bit)) {
+            scpi_operations.pending |= bit;
+            return token;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Finish overlapped operation, can be called from any thread. Waiting
+ * *OPC, *OPC? and *WAI are finished by SCPI_OperationSync on the session
+ * thread.
+ * @param token - token returned by SCPI_OperationBegin
+ */
+void SCPICore::SCPI_OperationComplete(int token) {
+    if (token < 0 || token >= 32) {
+        return;
+    }
+    scpi_operations.done.fetch_or((uint32_t)1 << token, std::memory_order_release);
+    operationWake();
+}
+
+/**
+ * Apply completed operations. If no operation is pending anymore, sets
+ * ESR OPC for *OPC, answers *OPC? and resumes commands held by *WAI.
+ * Called from transport side entry points (SCPI_Input, SCPI_OutputPeek,
+ * SCPI_StatusDispatch).
+ */
+void SCPICore::SCPI_OperationSync() {
+    uint32_t done;
+
+#if SCPI_USE_COROUTINES
+    if (scpi_operations.coroutine != NULL && scpi_operations.resume.load(std::memory_order_relaxed)
+            && scpi_operations.resume.exchange(false, std::memory_order_acquire)) {
+        coroutineResume();
+    }
+#endif
+
+    if (scpi_operations.done.load(std::memory_order_relaxed) != 0) {
+        done = scpi_operations.done.exchange(0, std::memory_order_acquire);
+        scpi_operations.pending &= ~done;
+    }
+
+    if (scpi_operations.pending != 0) {
+        return;
+    }
+
+    if (scpi_operations.opc) {
+        scpi_operations.opc = FALSE;
+        SCPI_RegSetBits(SCPI_REG_ESR, ESR_OPC);
+    }
+
+    if (scpi_operations.opcq || scpi_operations.wai) {
+        if (scpi_operations.opcq) {
+            scpi_operations.opcq = FALSE;
+            context.output_count = 0;
+            SCPI_ResultInt(1);
+            writeNewLine();
+        }
+        scpi_operations.wai = FALSE;
+        inputProcess();
+    }
+}
+
+/**
+ * Check for overlapped operations in progress
+ * @return TRUE if any operation is pending
+ */
+scpi_bool_t SCPICore::SCPI_OperationPending() {
+    SCPI_OperationSync();
+    return scpi_operations.pending != 0;
+}
+
+/**
+ * Let the executor drive the session. SCPI_OperationComplete and
+ * coroutine events then add the session to the executor, so the thread
+ * serving many sessions does not need to poll them. Set it before the
+ * session is used.
+ * @param executor - shared executor or NULL
+ */
+void SCPICore::SCPI_ExecutorAttach(scpi_executor_t * executor) {
+    scpi_operations.executor = executor;
+}
+
+/**
+ * Add the session to its executor, can be called from any thread.
+ * Session is added only once until the executor runs it.
+ */
+void SCPICore::operationWake() {
+    scpi_executor_t * executor = scpi_operations.executor;
+    SCPICore * head;
+
+    if (scpi_units != NULL) {
+        scpi_units->pool->schedule(this);
+        return;
+    }
+
+    if (executor == NULL || scpi_operations.queued.exchange(true, std::memory_order_acq_rel)) {
+        return;
+    }
+
+    head = executor->ready.load(std::memory_order_relaxed);
+    do {
+        scpi_operations.next = head;
+    } while (!executor->ready.compare_exchange_weak(head, this, std::memory_order_release, std::memory_order_relaxed));
+
+    if (head == NULL && executor->notify != NULL) {
+        executor->notify(executor->user_context);
+    }
+}
+
+/**
+ * Run sessions added to the executor, on the thread serving them.
+ * @param executor
+ * @return number of sessions run
+ */
+size_t SCPICore::SCPI_ExecutorRun(scpi_executor_t * executor) {
+    SCPICore * list = executor->ready.exchange(NULL, std::memory_order_acquire);
+    SCPICore * order = NULL;
+    SCPICore * next;
+    size_t count = 0;
+
+    /* sessions are pushed to the front, run them in order of wake up */
+    while (list != NULL) {
+        next = list->scpi_operations.next;
+        list->scpi_operations.next = order;
+        order = list;
+        list = next;
+    }
+
+    while (order != NULL) {
+        next = order->scpi_operations.next;
+        order->scpi_operations.queued.store(false, std::memory_order_release);
+        order->SCPI_RegSync();
+        order->SCPI_OperationSync();
+        order = next;
+        count++;
+    }
+
+    return count;
+}
+
+#if SCPI_USE_COROUTINES
+/**
+ * Event awaited by coroutine handler was set, can be called from any
+ * thread. Coroutine is resumed by SCPI_OperationSync.
+ */
+void SCPICore::SCPI_CoroutineWake() {
+    scpi_operations.resume.store(true, std::memory_order_release);
+    operationWake();
+}
+
+/**
+ * Resume suspended coroutine handler. If it returns, the command is
+ * finished and processing of following commands continues.
+ */
+void SCPICore::coroutineResume() {
+    std::coroutine_handle<scpi_task_t::promise_type> handle;
+    scpi_result_t result;
+
+    handle = std::coroutine_handle<scpi_task_t::promise_type>::from_address(scpi_operations.coroutine);
+    handle.resume();
+    if (!handle.done()) {
+        return;
+    }
+
+    result = handle.promise().result;
+    handle.destroy();
+    scpi_operations.coroutine = NULL;
+
+    commandFinish(result);
+    inputProcess();
+}
+
+/**
+ * Set the event and wake up coroutine awaiting it
+ */
+void scpi_event_t::set() {
+    if (state.exchange(SET, std::memory_order_acq_rel) == WAITING) {
+        parser->SCPI_CoroutineWake();
+    }
+}
+#endif
+
+
+
+const SCPICore::scpi_command_t SCPICore::scpi_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+const SCPICore::scpi_interface_t SCPICore::scpi_interface = {
+    /* error */ &SCPICore::SCPI_Error,
+    /* write */ &SCPICore::SCPI_Write,
+    /* writev */ &SCPICore::SCPI_WriteVector,
+    /* control */ &SCPICore::SCPI_Control,
+    /* flush */ &SCPICore::SCPI_Flush,
+    /* reset */ &SCPICore::SCPI_Reset,
+    /* test */ &SCPICore::SCPI_Test,
+};
+
+size_t SCPICore::SCPI_Write(const char *data, size_t len)
+{
+    /* replace with write of the transport, used if there is no output queue */
+    (void) data;
+    return len;
+}
+
+size_t SCPICore::SCPI_WriteVector(const scpi_iovec_t * iov, size_t iovcnt)
+{
+    /* replace with writev()/sendmsg() of the transport, scpi_iovec_t can be
+     * passed as struct iovec */
+    size_t result = 0;
+    size_t i;
+    for (i = 0; i < iovcnt; i++) {
+        result += SCPI_Write(iov[i].base, iov[i].len);
+    }
+    return result;
+}
+
+int SCPICore::SCPI_Error(int_fast16_t err)
+{
+    (void) err;
+    return 0;
+}
+
+scpi_result_t SCPICore::SCPI_Control(scpi_ctrl_name_t ctrl, scpi_reg_val_t val)
+{
+    /* status changes and SRQ are delivered to subscribers by statusNotify */
+    (void) ctrl;
+    (void) val;
+    return SCPI_RES_OK;
+}
+
+scpi_result_t SCPICore::SCPI_Reset()
+{
+    return SCPI_RES_OK;
+}
+
+scpi_result_t SCPICore::SCPI_Flush()
+{
+    return SCPI_RES_OK;
+}
+
+scpi_result_t SCPICore::SCPI_Test()
+{
+    return SCPI_RES_OK;
+}
@@ -0,0 +1,930 @@
+#ifndef SCPICORE_H
+#define SCPICORE_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <atomic>
+
+#include "config.h"
+#include "ieee488.h"
+#include "error.h"
+#include "constants.h"
+
+#include "units.h"
+#include <utils_private.h>
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+#ifndef TRUE
+#define TRUE (!FALSE)
+#endif
+
+/* scpi commands */
+typedef enum _scpi_result_t {
+    SCPI_RES_OK = 1,
+    SCPI_RES_PENDING = 2, /* overlapped command, see SCPI_OperationBegin */
+    SCPI_RES_ERR = -1
+}scpi_result_t;
+
+#include "scpicoroutine.h"
+
+/* scpi units */
+enum scpi_unit_t {
+    SCPI_UNIT_NONE,
+    SCPI_UNIT_VOLT,
+    SCPI_UNIT_AMPER,
+    SCPI_UNIT_OHM,
+    SCPI_UNIT_HERTZ,
+    SCPI_UNIT_CELSIUS,
+    SCPI_UNIT_SECONDS,
+    SCPI_UNIT_DISTANCE
+};
+
+/* decimal number, mantissa * 10^exponent */
+struct scpi_decimal_t {
+    int64_t mantissa;
+    int16_t exponent;
+};
+
+#if SCPI_USE_FIXED_POINT
+typedef scpi_decimal_t scpi_real_t;
+#define SCPI_MULT(value, mantissa, exponent) {mantissa, exponent}
+#else
+typedef double scpi_real_t;
+#define SCPI_MULT(value, mantissa, exponent) value
+#endif
+
+/* mult is written by SCPI_MULT(value, mantissa, exponent), so the table
+ * builds in both number profiles */
+struct scpi_unit_def_t {
+    const char * name;
+    scpi_unit_t unit;
+    scpi_real_t mult;
+};
+#define SCPI_UNITS_LIST_END       {NULL, SCPI_UNIT_NONE, SCPI_MULT(0, 0, 0)}
+
+enum scpi_special_number_t {
+    SCPI_NUM_NUMBER,
+    SCPI_NUM_MIN,
+    SCPI_NUM_MAX,
+    SCPI_NUM_DEF,
+    SCPI_NUM_UP,
+    SCPI_NUM_DOWN,
+    SCPI_NUM_NAN,
+    SCPI_NUM_INF,
+    SCPI_NUM_NINF
+};
+
+struct scpi_special_number_def_t {
+    const char * name;
+    scpi_special_number_t type;
+};
+#define SCPI_SPECIAL_NUMBERS_LIST_END   {NULL, SCPI_NUM_NUMBER}
+
+struct scpi_number_t {
+    scpi_real_t value;
+    scpi_unit_t unit;
+    scpi_special_number_t type;
+};
+
+/* IEEE 488.2 registers */
+enum scpi_reg_name_t {
+    SCPI_REG_STB = 0, /* Status Byte */
+    SCPI_REG_SRE,     /* Service Request Enable Register */
+    SCPI_REG_ESR,     /* Standard Event Status Register (ESR, SESR) */
+    SCPI_REG_ESE,     /* Event Status Enable Register */
+    SCPI_REG_OPER,    /* OPERation Status Register */
+    SCPI_REG_OPERE,   /* OPERation Status Enable Register */
+    SCPI_REG_QUES,    /* QUEStionable status register */
+    SCPI_REG_QUESE,   /* QUEStionable status Enable Register */
+    SCPI_REG_OPERC,   /* OPERation Status Condition Register */
+    SCPI_REG_OPERPTR, /* OPERation Status Positive Transition filter */
+    SCPI_REG_OPERNTR, /* OPERation Status Negative Transition filter */
+    SCPI_REG_QUESC,   /* QUEStionable status Condition Register */
+    SCPI_REG_QUESPTR, /* QUEStionable status Positive Transition filter */
+    SCPI_REG_QUESNTR, /* QUEStionable status Negative Transition filter */
+
+    /* device specific registers, e.g.
+     * #define SCPI_USER_REGISTERS SCPI_REG_VOLT, SCPI_REG_VOLTE, ... */
+#ifdef SCPI_USER_REGISTERS
+    SCPI_USER_REGISTERS,
+#endif
+
+    /* last definition - number of registers */
+    SCPI_REG_COUNT
+};
+
+enum scpi_ctrl_name_t {
+    SCPI_CTRL_SRQ = 1, /* service request */
+    SCPI_CTRL_GTL,     /* Go to local */
+    SCPI_CTRL_SDC,     /* Selected device clear */
+    SCPI_CTRL_PPC,     /* Parallel poll configure */
+    SCPI_CTRL_GET,     /* Group execute trigger */
+    SCPI_CTRL_TCT,     /* Take control */
+    SCPI_CTRL_LLO,     /* Device clear */
+    SCPI_CTRL_DCL,     /* Local lockout */
+    SCPI_CTRL_PPU,     /* Parallel poll unconfigure */
+    SCPI_CTRL_SPE,     /* Serial poll enable */
+    SCPI_CTRL_SPD,     /* Serial poll disable */
+    SCPI_CTRL_MLA,     /* My local address */
+    SCPI_CTRL_UNL,     /* Unlisten */
+    SCPI_CTRL_MTA,     /* My talk address */
+    SCPI_CTRL_UNT,     /* Untalk */
+    SCPI_CTRL_MSA      /* My secondary address */
+};
+
+typedef uint16_t scpi_reg_val_t;
+
+/* status register group (SCPI-99 9.1), registers not present in the group
+ * are SCPI_REG_COUNT. Without ptr every positive transition is latched,
+ * without ntr no negative one, without enable the summary stays 0.
+ * Summary of the group (event & enable) is bit parent_bit of parent, which
+ * is condition register of another group or STB. */
+struct scpi_reg_group_t {
+    scpi_reg_name_t condition;
+    scpi_reg_name_t ptr;
+    scpi_reg_name_t ntr;
+    scpi_reg_name_t event;
+    scpi_reg_name_t enable;
+    scpi_reg_name_t parent;
+    scpi_reg_val_t parent_bit;
+};
+#define SCPI_REG_GROUPS_LIST_END   {SCPI_REG_COUNT, SCPI_REG_COUNT, SCPI_REG_COUNT, SCPI_REG_COUNT, SCPI_REG_COUNT, SCPI_REG_COUNT, 0}
+#define SCPI_REG_GROUP_NONE 0xFF
+
+class SCPICore;
+class SCPIWorkerPool;
+
+/* sessions with completed operations or resumed coroutines, shared by
+ * sessions served by one thread. Sessions are added from any thread,
+ * notify is called when the first one is added, SCPI_ExecutorRun has to
+ * be called then on the thread serving the sessions. */
+struct scpi_executor_t {
+    std::atomic<SCPICore *> ready;
+    void (*notify)(void * user_context);
+    void * user_context;
+};
+
+/* parameter kinds of bound commands, see scpibind.h */
+enum scpi_param_kind_t {
+    SCPI_PARAM_NUMBER,
+    SCPI_PARAM_INT,
+    SCPI_PARAM_BOOL,
+    SCPI_PARAM_CHOICE
+};
+
+/* one parameter of bound command
+ * unit - unit of number, number with other unit is refused
+ * min, max, def - range of number, MINimum, MAXimum and DEFault resolve to them
+ * imin, imax, idef - the same for integer
+ * options - patterns of choice, ends by NULL */
+struct scpi_param_def_t {
+    scpi_param_kind_t kind;
+    scpi_unit_t unit;
+    scpi_real_t min;
+    scpi_real_t max;
+    scpi_real_t def;
+    int32_t imin;
+    int32_t imax;
+    int32_t idef;
+    const char * const * options;
+};
+
+/* parsed parameter, member is given by kind (choice is integer) */
+union scpi_param_value_t {
+    scpi_real_t number;
+    int32_t integer;
+    bool flag;
+};
+
+/* command bound by SCPI_Bind, invoke parses all parameters by the schema
+ * and calls the handler with typed arguments. target is the object of
+ * generated commands (setting), NULL otherwise. */
+struct scpi_binding_t {
+    scpi_result_t (*invoke)(SCPICore * session, const scpi_binding_t * binding);
+    const scpi_param_def_t * params;
+    size_t count;
+    void * target;
+};
+
+#define SCPI_SETTING_WORDS ((sizeof(scpi_param_value_t) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+/* value set and queried by generated commands (SCPI_SETTING, scpibind.h).
+ * Any thread reads it by SCPI_SettingGet without locking: value is
+ * guarded by seqlock, reader repeats the read if a write overlapped it and
+ * never blocks the writer. Writers (sessions, SCPI_SettingSet) take odd
+ * sequence one at a time. The initial value is DEFault of the schema.
+ * changed - called on the session thread after the setter stored value */
+struct scpi_setting_t {
+    scpi_param_def_t param;
+    scpi_binding_t set;
+    scpi_binding_t query;
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint32_t> data[SCPI_SETTING_WORDS];
+    void (*changed)(scpi_setting_t * setting, void * user_context);
+    void * user_context;
+
+    scpi_setting_t(const scpi_param_def_t & param);
+};
+
+
+/*
+ * Parser session, no dependency on Qt. SCPIParser (scpiparser.h) adapts it
+ * to Qt signals, scpi.h is its C interface. Input buffer, error queue and
+ * output queue are owned by SCPIBasicSession, which sizes them at compile
+ * time; SCPISession has the default sizes.
+ */
+class SCPICore
+{
+public:
+    struct scpi_instrument_t;
+    struct _fifo_slot_t;
+
+    virtual ~SCPICore();
+    void init(const scpi_instrument_t * instrument);
+
+protected:
+    SCPICore(const scpi_instrument_t * instrument, char * input, size_t input_len, _fifo_slot_t * errors, size_t errors_len, char * output, size_t output_len);
+    virtual void statusSignal(int stb, int changed, bool srq);
+
+public:
+
+    typedef bool scpi_bool_t;
+    /* typedef enum { FALSE = 0, TRUE } scpi_bool_t; */
+
+
+    /* scpi interface */
+    /* scan - part of the data already searched for line terminator
+     * overrun - rest of too long command line is discarded
+     * ring - if set, data is a window moving over ring of length bytes
+     * mapped twice back to back, see SCPI_InputAttach */
+    struct scpi_buffer_t {
+        size_t length;
+        size_t position;
+        size_t scan;
+        scpi_bool_t overrun;
+        char * data;
+        char * ring;
+    };
+
+    /* IEEE 488.2 output queue, read by the transport with SCPI_OutputRead.
+     * If data is NULL, results are written directly by interface write.
+     * With pipeline set, next program message waits until the queue is read,
+     * otherwise it interrupts unread response (-410, Query INTERRUPTED).
+     * If ring is set, data is a window moving over mirrored ring, see
+     * SCPI_OutputAttach. Every response message ends with terminator,
+     * see SCPI_ResponseTerminator. Response which does not fit into the queue
+     * spills to heap (spill_rd to spill_len of spill_size bytes) and moves to
+     * the queue as the transport reads it. */
+    struct scpi_output_queue_t {
+        size_t length;
+        size_t rd;
+        size_t wr;
+        size_t message;
+        scpi_bool_t overflow;
+        scpi_bool_t pipeline;
+        char * data;
+        char * ring;
+        const char * terminator;
+        size_t terminator_len;
+        char * spill;
+        size_t spill_rd;
+        size_t spill_len;
+        size_t spill_size;
+    };
+
+    /* scatter/gather element, same member order as POSIX struct iovec */
+    struct scpi_iovec_t {
+        const char * base;
+        size_t len;
+    };
+
+
+    typedef size_t(SCPICore::*scpi_write_t)(const char * data, size_t len);
+    typedef size_t(SCPICore::*scpi_write_vector_t)(const scpi_iovec_t * iov, size_t iovcnt);
+    typedef scpi_result_t(SCPICore::*scpi_write_control_t)(scpi_ctrl_name_t ctrl, scpi_reg_val_t val);
+    typedef int (SCPICore::*scpi_error_callback_t)(int_fast16_t error);
+
+    typedef scpi_result_t(SCPICore::*scpi_command_callback_t)();
+#if SCPI_USE_COROUTINES
+    typedef scpi_task_t(SCPICore::*scpi_coroutine_callback_t)();
+#endif
+
+    /* producer of streamed result, returns next chunk of at most len bytes
+     * in *data or 0 at the end of the stream */
+    typedef size_t(SCPICore::*scpi_stream_producer_t)(const char ** data, size_t len, void * user_context);
+
+    /* scpi error queue */
+    typedef void * scpi_error_queue_t;
+
+
+    /* command table entry, tables list pattern and handler in this order,
+     * fields not given are NULL */
+    struct scpi_command_t {
+        const char * pattern;
+        scpi_command_callback_t callback;
+#if SCPI_USE_COROUTINES
+        scpi_coroutine_callback_t coroutine;
+#endif
+        const scpi_binding_t * binding;
+
+#if SCPI_USE_COROUTINES
+        constexpr scpi_command_t(const char * pattern = NULL, scpi_command_callback_t callback = NULL,
+                                 scpi_coroutine_callback_t coroutine = NULL, const scpi_binding_t * binding = NULL) :
+            pattern(pattern), callback(callback), coroutine(coroutine), binding(binding) {}
+#else
+        constexpr scpi_command_t(const char * pattern = NULL, scpi_command_callback_t callback = NULL,
+                                 const scpi_binding_t * binding = NULL) :
+            pattern(pattern), callback(callback), binding(binding) {}
+#endif
+    };
+
+    struct scpi_param_list_t {
+        const scpi_command_t * cmd;
+        const char * parameters;
+        size_t length;
+    };
+#define SCPI_CMD_LIST_END       {NULL, NULL, }
+
+    struct scpi_stream_t {
+        scpi_stream_producer_t producer;
+        void * user_context;
+    };
+
+    /* overlapped commands, one bit per token
+     * pending - operations in progress, session thread only
+     * done - completed operations, set from any thread
+     * opc, opcq, wai - *OPC, *OPC? and *WAI wait for all operations
+     * coroutine, resume - suspended coroutine handler and its wake up
+     * executor, queued, next - executor driving the session */
+    struct scpi_operations_t {
+        uint32_t pending;
+        std::atomic<uint32_t> done;
+        scpi_bool_t opc;
+        scpi_bool_t opcq;
+        scpi_bool_t wai;
+        void * coroutine;
+        std::atomic<bool> resume;
+        scpi_executor_t * executor;
+        std::atomic<bool> queued;
+        SCPICore * next;
+    };
+
+    /* state of command line suspended in the middle */
+    struct scpi_parse_state_t {
+        char * rest;
+        char * end;
+        char * prev;
+        size_t prev_len;
+    };
+
+    struct scpi_interface_t {
+        scpi_error_callback_t error;
+        scpi_write_t write;
+        scpi_write_vector_t writev;
+        scpi_write_control_t control;
+        scpi_command_callback_t flush;
+        scpi_command_callback_t reset;
+        scpi_command_callback_t test;
+    };
+
+
+    /* per session state, everything immutable is in instrument */
+    struct _scpi_t {
+        const scpi_instrument_t * instrument;
+        scpi_buffer_t buffer;
+        scpi_output_queue_t output;
+        scpi_param_list_t paramlist;
+        int_fast16_t output_count;
+        int_fast16_t input_count;
+        scpi_bool_t cmd_error;
+        scpi_error_queue_t error_queue;
+        scpi_reg_val_t * registers;
+        void * user_context;
+        scpi_stream_t stream;
+        scpi_parse_state_t parse;
+    };
+    typedef struct _scpi_t scpi_t;
+
+    /* default error queue capacity, must be power of two */
+#ifndef FIFO_SIZE
+#define FIFO_SIZE 16
+#endif
+
+    /* maximal length of error detail text */
+#ifndef SCPI_ERROR_INFO_LENGTH
+#define SCPI_ERROR_INFO_LENGTH 32
+#endif
+
+    /* error queue entry, detail text is stored in place */
+    struct scpi_error_t {
+        int16_t code;
+        uint8_t info_len;
+        char info[SCPI_ERROR_INFO_LENGTH];
+    };
+    static_assert(SCPI_ERROR_INFO_LENGTH <= 255, "SCPI_ERROR_INFO_LENGTH must fit into info_len");
+
+    /* bounded lock-free queue, multiple producers and single consumer */
+    struct _fifo_slot_t {
+        std::atomic<uint32_t> seq;
+        scpi_error_t value;
+    };
+
+    struct _fifo_t {
+        std::atomic<uint32_t> wr;
+        uint32_t rd;
+        uint32_t mask;
+        std::atomic<bool> overflow;
+        struct _fifo_slot_t * data;
+    };
+    typedef struct _fifo_t fifo_t;
+
+#define SCPI_DEBUG_COMMAND(a)
+
+    struct error_reg {
+        int16_t from;
+        int16_t to;
+        scpi_reg_val_t bit;
+    };
+
+#define ERROR_DEFS_N	8
+
+    /* error number to text table, open addressing, must be power of two */
+#ifndef SCPI_ERROR_REGISTRY_SIZE
+#define SCPI_ERROR_REGISTRY_SIZE 64
+#endif
+
+    struct scpi_error_def_t {
+        int16_t code;
+        const char * text;
+    };
+    static_assert((SCPI_ERROR_REGISTRY_SIZE & (SCPI_ERROR_REGISTRY_SIZE - 1)) == 0, "SCPI_ERROR_REGISTRY_SIZE must be power of two");
+
+    /* maximal number of commands in command index, longer command lists
+     * are searched sequentially */
+#ifndef SCPI_INDEX_SIZE
+#define SCPI_INDEX_SIZE 256
+#endif
+
+    /* command index buckets: patterns not starting with a letter or '*',
+     * '*' (common commands) and 'A' to 'Z' */
+#define SCPI_INDEX_BUCKETS 28
+
+    /*
+     * Definition of the instrument shared by all its sessions. It is set up
+     * once by SCPI_InstrumentInit, optionally modified (idn, units, device
+     * specific errors) and must not change when sessions use it.
+     */
+    struct scpi_instrument_t {
+        const scpi_command_t * cmdlist;
+        const scpi_interface_t * interface;
+        const scpi_unit_def_t * units;
+        const scpi_special_number_def_t * special_numbers;
+        const scpi_reg_group_t * reg_groups;
+        /* index to reg_groups of the group with the register as condition,
+         * event or enable, SCPI_REG_GROUP_NONE if it is in no group */
+        uint8_t reg_group[SCPI_REG_COUNT];
+        const char * idn[4];
+        scpi_error_def_t error_registry[SCPI_ERROR_REGISTRY_SIZE];
+        /* cmdlist positions grouped by first letter of the pattern, bucket b
+         * is index[bucket[b]] to index[bucket[b + 1] - 1] in cmdlist order */
+        scpi_bool_t indexed;
+        uint16_t bucket[SCPI_INDEX_BUCKETS + 1];
+        uint16_t index[SCPI_INDEX_SIZE];
+    };
+
+    static void SCPI_InstrumentInit(scpi_instrument_t * instrument, const scpi_command_t * cmdlist);
+    static void SCPI_InstrumentRegGroups(scpi_instrument_t * instrument, const scpi_reg_group_t * reg_groups);
+    static const scpi_instrument_t * SCPI_InstrumentDefault();
+    static int indexBucket(const char * header, size_t len);
+
+    void SCPI_Init();
+    int SCPI_Input(const char * data, size_t len);
+    int SCPI_InputDispatch(const char * data, size_t len);
+    char * SCPI_InputBuffer(size_t * len);
+    int SCPI_InputCommit(size_t len);
+    scpi_bool_t SCPI_InputIdle();
+    int SCPI_InputEnd();
+    void SCPI_DeviceClear();
+    void SCPI_InputAttach(char * ring, size_t size);
+
+
+    int SCPI_Parse(char * data, size_t len);
+    size_t SCPI_ResultString(const char * data);
+    size_t SCPI_ResultInt(int32_t val);
+#if !SCPI_USE_FIXED_POINT
+    size_t SCPI_ResultDouble(double val);
+#endif
+    size_t SCPI_ResultDecimal(scpi_decimal_t val);
+    size_t SCPI_ResultText(const char * data);
+    size_t SCPI_ResultBool(scpi_bool_t val);
+    size_t SCPI_ResultArbitraryBlock(const char * data, size_t len);
+    size_t SCPI_ResultError(const scpi_error_t * error);
+    size_t resultErrorLength(const scpi_error_t * error);
+    size_t SCPI_ResultStream(scpi_stream_producer_t producer, void * user_context);
+    int SCPI_StreamPull(size_t len);
+
+    size_t SCPI_OutputPeek(const char ** data);
+    void SCPI_OutputConsume(size_t len);
+    size_t SCPI_OutputRead(char * data, size_t len);
+    size_t SCPI_OutputCount();
+    void SCPI_OutputClear();
+    scpi_bool_t SCPI_ResponseComplete();
+    void SCPI_OutputAttach(char * ring, size_t size);
+    void SCPI_ResponseTerminator(const char * terminator);
+
+    scpi_bool_t SCPI_ParamInt(int32_t * value, scpi_bool_t mandatory);
+#if !SCPI_USE_FIXED_POINT
+    scpi_bool_t SCPI_ParamDouble(double * value, scpi_bool_t mandatory);
+#endif
+    scpi_bool_t SCPI_ParamDecimal(scpi_decimal_t * value, scpi_bool_t mandatory);
+    scpi_bool_t SCPI_ParamString(const char ** value, size_t * len, scpi_bool_t mandatory);
+    scpi_bool_t SCPI_ParamText(const char ** value, size_t * len, scpi_bool_t mandatory);
+    scpi_bool_t SCPI_ParamBool(scpi_bool_t * value, scpi_bool_t mandatory);
+    scpi_bool_t SCPI_ParamChoice(const char * options[], int32_t * value, scpi_bool_t mandatory);
+    scpi_bool_t SCPI_ParamSchema(const scpi_param_def_t * params, size_t count, scpi_param_value_t * values);
+    scpi_bool_t paramValue(const scpi_param_def_t * param, const char * str, size_t len, scpi_param_value_t * value);
+    scpi_bool_t paramLimit(const scpi_param_def_t * param, scpi_special_number_t type, scpi_param_value_t * value);
+
+    static void SCPI_SettingGet(const scpi_setting_t * setting, scpi_param_value_t * value);
+    static void SCPI_SettingSet(scpi_setting_t * setting, const scpi_param_value_t * value);
+    static scpi_result_t settingSet(SCPICore * session, const scpi_binding_t * binding);
+    static scpi_result_t settingQuery(SCPICore * session, const scpi_binding_t * binding);
+    size_t settingResult(const scpi_param_def_t * param, const scpi_param_value_t * value);
+
+    scpi_bool_t translateSpecialNumber(const scpi_special_number_def_t * specs, const char * str, size_t len, scpi_number_t * value);
+    const char * translateSpecialNumberInverse(const scpi_special_number_def_t * specs, scpi_special_number_t type);
+    const scpi_unit_def_t * translateUnit(const scpi_unit_def_t * units, const char * unit, size_t len);
+    scpi_bool_t transformNumber(const char * unit, size_t len, scpi_number_t * value);
+    const char * translateUnitInverse(const scpi_unit_def_t * units, const scpi_unit_t unit);
+
+
+
+    size_t writeData(const char * data, size_t len);
+    size_t writeDataVector(const scpi_iovec_t * iov, size_t iovcnt);
+    size_t outputWrite(const char * data, size_t len);
+    size_t outputSpill(const char * data, size_t len);
+    void outputDrain();
+    size_t outputFree();
+    void outputRelease(size_t len);
+    void outputUpdateMAV();
+
+    int flushData() ;
+    size_t writeDelimiter();
+    size_t writeNewLine();
+    void processCommand();
+    void commandFinish(scpi_result_t result);
+    int parseCommands(char * cmdline_ptr, const char * cmdline_end);
+    int inputProcess();
+    void inputShift(size_t len);
+    void inputTerminate();
+    const char * inputTerminator(size_t ws);
+    scpi_bool_t inputOverrun();
+    void inputDiscard();
+    scpi_bool_t inputBlocked();
+    scpi_bool_t findCommand(const char * cmdline_ptr, size_t cmdline_len, size_t cmd_len);
+    const scpi_command_t * lookupCommand(const char * header, size_t len);
+    int dispatchProcess();
+    scpi_bool_t dispatchCommands(char * cmdline_ptr, const char * cmdline_end);
+    void SCPI_ErrorAddInternal(const scpi_error_t * error);
+    fifo_t local_error_queue;
+
+    static const struct error_reg errs[ERROR_DEFS_N];
+
+    size_t cmdTerminatorPos(const char * cmd, size_t len);
+    size_t cmdlineSeparatorPos(const char * cmd, size_t len);
+    const char * cmdlineSeparator(const char * cmd, size_t len);
+    const char * cmdlineTerminator(const char * cmd, size_t len);
+    size_t skipCmdLine(const char * cmd, size_t len);
+
+    void paramSkipBytes(size_t num);
+    void paramSkipWhitespace();
+    scpi_bool_t paramNext(scpi_bool_t mandatory);
+
+    //error
+    void SCPI_ErrorInit();
+    void SCPI_ErrorClear();
+    int16_t SCPI_ErrorPop();
+    scpi_bool_t SCPI_ErrorPopEx(scpi_error_t * error);
+    scpi_bool_t SCPI_ErrorPeekEx(scpi_error_t * error);
+    void SCPI_ErrorPush(int16_t err);
+    void SCPI_ErrorPushEx(int16_t err, const char * info, size_t info_len);
+    void SCPI_ErrorPushAsync(int16_t err, const char * info, size_t info_len);
+    static scpi_bool_t SCPI_ErrorRegister(scpi_instrument_t * instrument, int16_t err, const char * text);
+    void errorFill(scpi_error_t * error, int16_t err, const char * info, size_t info_len);
+    scpi_reg_val_t errorESRBits(int16_t err);
+    int32_t SCPI_ErrorCount();
+    const char * SCPI_ErrorTranslate(int16_t err);
+
+    //debug
+    scpi_bool_t SCPI_DebugCommand();
+
+    //fifo
+
+    void fifo_init(fifo_t * fifo);
+    void fifo_clear(fifo_t * fifo);
+    scpi_bool_t fifo_add(fifo_t * fifo, const scpi_error_t * value);
+    scpi_bool_t fifo_remove(fifo_t * fifo, scpi_error_t * value);
+    scpi_bool_t fifo_peek(fifo_t * fifo, scpi_error_t * value);
+    scpi_bool_t fifo_count(fifo_t * fifo, int16_t * value);
+
+
+    //units
+    static const scpi_unit_def_t scpi_units_def[];
+    static const scpi_special_number_def_t scpi_special_numbers_def[];
+
+
+
+    scpi_bool_t SCPI_ParamNumber(scpi_number_t * value, scpi_bool_t mandatory);
+    size_t SCPI_NumberToStr(scpi_number_t * value, char * str, size_t len);
+
+
+
+    //ieee
+    scpi_result_t SCPI_CoreCls();
+    scpi_result_t SCPI_CoreEse();
+    scpi_result_t SCPI_CoreEseQ();
+    scpi_result_t SCPI_CoreEsrQ();
+    scpi_result_t SCPI_CoreIdnQ();
+    scpi_result_t SCPI_CoreOpc();
+    scpi_result_t SCPI_CoreOpcQ();
+    scpi_result_t SCPI_CoreRst();
+    scpi_result_t SCPI_CoreSre();
+    scpi_result_t SCPI_CoreSreQ();
+    scpi_result_t SCPI_CoreStbQ();
+    scpi_result_t SCPI_CoreTstQ();
+    scpi_result_t SCPI_CoreWai();
+
+    //system
+    scpi_result_t SCPI_SystemErrorNextQ();
+    scpi_result_t SCPI_SystemErrorAllQ();
+    void SCPI_EventClear() ;
+
+
+#define STB_R01 0x01    /* Not used */
+#define STB_PRO 0x02    /* Protection Event Flag */
+#define STB_QMA 0x04    /* Error/Event queue message available */
+#define STB_QES 0x08    /* Questionable status */
+#define STB_MAV 0x10    /* Message Available */
+#define STB_ESR 0x20    /* Standard Event Status Register */
+#define STB_SRQ 0x40    /* Service Request */
+#define STB_OPS 0x80    /* Operation Status Flag */
+
+
+#define ESR_OPC 0x01    /* Operation complete */
+#define ESR_REQ 0x02    /* Request Control */
+#define ESR_QER 0x04    /* Query Error */
+#define ESR_DER 0x08    /* Device Dependent Error */
+#define ESR_EER 0x10    /* Execution Error (e.g. range error) */
+#define ESR_CER 0x20    /* Command error (e.g. syntax error) */
+#define ESR_URQ 0x40    /* User Request */
+#define ESR_PON 0x80    /* Power On */
+
+
+    scpi_reg_val_t SCPI_RegGet(scpi_reg_name_t name);
+    void SCPI_RegSet(scpi_reg_name_t name, scpi_reg_val_t val);
+    void SCPI_RegSetBits(scpi_reg_name_t name, scpi_reg_val_t bits);
+    void SCPI_RegClearBits(scpi_reg_name_t name, scpi_reg_val_t bits);
+    void SCPI_RegSetBitsAsync(scpi_reg_name_t name, scpi_reg_val_t bits);
+    void SCPI_RegClearBitsAsync(scpi_reg_name_t name, scpi_reg_val_t bits);
+    void SCPI_RegSync();
+    void SCPI_RegInit();
+    const scpi_reg_group_t * regGroupByCondition(scpi_reg_name_t name);
+    const scpi_reg_group_t * regGroup(scpi_reg_name_t name);
+    void regPropagate(const scpi_reg_group_t * group);
+    void regStatus(scpi_reg_val_t old_stb);
+    void regWrite(scpi_reg_name_t name, scpi_reg_val_t set, scpi_reg_val_t clear);
+    void regSetCondition(const scpi_reg_group_t * group, scpi_reg_val_t set, scpi_reg_val_t clear);
+    scpi_reg_val_t regTransitions(const scpi_reg_group_t * group, scpi_reg_val_t raised, scpi_reg_val_t lowered);
+    void regUpdate();
+    size_t writeControl(scpi_ctrl_name_t ctrl, scpi_reg_val_t val);
+
+
+    static const scpi_command_t scpi_commands[];
+    size_t SCPI_Write(const char * data, size_t len);
+    size_t SCPI_WriteVector(const scpi_iovec_t * iov, size_t iovcnt);
+    int SCPI_Error(int_fast16_t err);
+    scpi_result_t SCPI_Control(scpi_ctrl_name_t ctrl, scpi_reg_val_t val);
+    scpi_result_t SCPI_Reset();
+    scpi_result_t SCPI_Test();
+    scpi_result_t SCPI_Flush();
+
+    static const scpi_interface_t scpi_interface;
+
+    scpi_reg_val_t scpi_regs[SCPI_REG_COUNT];
+
+    /* register changes made by other threads, applied by SCPI_RegSync.
+     * condition - current value of condition registers
+     * raised, lowered - bits changed since last SCPI_RegSync */
+    struct scpi_reg_async_t {
+        std::atomic<bool> dirty;
+        std::atomic<scpi_reg_val_t> condition[SCPI_REG_COUNT];
+        std::atomic<scpi_reg_val_t> raised[SCPI_REG_COUNT];
+        std::atomic<scpi_reg_val_t> lowered[SCPI_REG_COUNT];
+    };
+    scpi_reg_async_t scpi_regs_async;
+
+    /* status change subscriptions, notified with callback or by writing
+     * 8 byte counter to fd (eventfd, pipe) */
+    typedef void (*scpi_status_callback_t)(void * user_context, scpi_reg_val_t stb, scpi_reg_val_t changed);
+
+#ifndef SCPI_STATUS_SUBSCRIBERS
+#define SCPI_STATUS_SUBSCRIBERS 4
+#endif
+
+    struct scpi_status_subscriber_t {
+        scpi_status_callback_t callback;
+        void * user_context;
+        int fd;
+        scpi_reg_val_t mask;
+    };
+
+    /* first change is delivered immediately, further changes within
+     * window ms are coalesced and delivered by SCPI_StatusDispatch when
+     * the window closes, 0 delivers every change immediately. mask joins
+     * masks of all subscribers. clock gives time of the window in ms. */
+    struct scpi_status_t {
+        scpi_reg_val_t mask;
+        scpi_reg_val_t changed;
+        scpi_bool_t srq;
+        uint32_t window;
+        uint32_t last;
+        uint32_t (*clock)();
+        scpi_status_subscriber_t subscribers[SCPI_STATUS_SUBSCRIBERS];
+    };
+    scpi_status_t scpi_status;
+
+    scpi_operations_t scpi_operations;
+
+    /* command units queue capacity, must be power of two */
+#ifndef SCPI_UNIT_QUEUE_SIZE
+#define SCPI_UNIT_QUEUE_SIZE 16
+#endif
+
+    /* maximal length of parameters of one command unit */
+#ifndef SCPI_UNIT_PARAMETERS_LENGTH
+#define SCPI_UNIT_PARAMETERS_LENGTH 64
+#endif
+
+    /* command resolved by SCPI_InputDispatch, if cmd is NULL, error is
+     * pushed to error queue when the unit is executed. Parameters are
+     * terminated like the input buffer, numbers are parsed up to '\0'. */
+    struct scpi_cmd_unit_t {
+        const scpi_command_t * cmd;
+        int16_t error;
+        uint16_t length;
+        char parameters[SCPI_UNIT_PARAMETERS_LENGTH + 1];
+    };
+
+    /* units of one session, written by the transport thread, executed in
+     * order by at most one worker of the pool at a time
+     * scheduled - session is queued or running in the pool
+     * notified - new units or wake up since the session started running
+     * stalled - dispatching waits for free unit, pool drained is called
+     * suspended - first unit is coroutine command still running
+     * write - output of the session, called on the worker running it */
+    struct scpi_units_t {
+        std::atomic<uint32_t> wr;
+        std::atomic<uint32_t> rd;
+        std::atomic<bool> scheduled;
+        std::atomic<bool> notified;
+        std::atomic<bool> stalled;
+        scpi_bool_t suspended;
+        SCPIWorkerPool * pool;
+        size_t (*write)(SCPICore * session, const char * data, size_t len, void * user_context);
+        void * user_context;
+        scpi_cmd_unit_t data[SCPI_UNIT_QUEUE_SIZE];
+    };
+    static_assert((SCPI_UNIT_QUEUE_SIZE & (SCPI_UNIT_QUEUE_SIZE - 1)) == 0, "SCPI_UNIT_QUEUE_SIZE must be power of two");
+    scpi_units_t * scpi_units;
+
+    int SCPI_PoolAttach(SCPIWorkerPool * pool, size_t (*write)(SCPICore * session, const char * data, size_t len, void * user_context), void * user_context);
+    size_t SCPI_UnitsRun(size_t budget);
+    scpi_bool_t unitPush(const scpi_command_t * cmd, int16_t error, const char * parameters, size_t length);
+    scpi_bool_t unitSpace();
+    void unitRelease();
+
+    /* byte ingress ring capacity, must be power of two */
+#ifndef SCPI_INGRESS_SIZE
+#define SCPI_INGRESS_SIZE 1024
+#endif
+
+    /* raw input pushed without locking by transports on any thread
+     * (serial interrupt, socket thread) and drained by the parser thread.
+     * Each push reserves a chunk with a header, the header is written
+     * last, so the parser never sees partially copied data.
+     * wr - reserved by producers, rd - released by the parser
+     * offset - part of the first chunk already moved to the input buffer
+     * wake - parser was notified and did not start draining yet */
+    struct scpi_ingress_t {
+        std::atomic<uint32_t> wr;
+        std::atomic<uint32_t> rd;
+        std::atomic<bool> wake;
+        uint32_t offset;
+        void (*notify)(SCPICore * session, void * user_context);
+        void * user_context;
+        alignas(4) char data[SCPI_INGRESS_SIZE];
+    };
+    static_assert((SCPI_INGRESS_SIZE & (SCPI_INGRESS_SIZE - 1)) == 0, "SCPI_INGRESS_SIZE must be power of two");
+    static_assert(SCPI_INGRESS_SIZE >= 8, "SCPI_INGRESS_SIZE must hold chunk header and data");
+    scpi_ingress_t * scpi_ingress;
+
+    int SCPI_IngressAttach(void (*notify)(SCPICore * session, void * user_context), void * user_context);
+    size_t SCPI_IngressPush(const char * data, size_t len);
+    int SCPI_IngressDrain();
+    size_t ingressMove();
+
+    int SCPI_OperationBegin();
+    void SCPI_OperationComplete(int token);
+    void SCPI_OperationSync();
+    scpi_bool_t SCPI_OperationPending();
+    void SCPI_ExecutorAttach(scpi_executor_t * executor);
+    static size_t SCPI_ExecutorRun(scpi_executor_t * executor);
+    void operationWake();
+#if SCPI_USE_COROUTINES
+    void SCPI_CoroutineWake();
+    void coroutineResume();
+#endif
+
+    int SCPI_StatusSubscribe(scpi_status_callback_t callback, void * user_context, scpi_reg_val_t mask);
+    int SCPI_StatusSubscribeFd(int fd, scpi_reg_val_t mask);
+    void SCPI_StatusUnsubscribe(int id);
+    void SCPI_StatusWindow(uint32_t window);
+    void SCPI_StatusClock(uint32_t (*clock)());
+    int32_t SCPI_StatusDispatch();
+    static uint32_t statusClock();
+    void statusNotify(scpi_reg_val_t changed, scpi_bool_t srq);
+    void statusDeliver();
+
+    static const scpi_reg_group_t scpi_reg_groups[];
+
+    scpi_t context = {
+        /* instrument */ NULL,
+        /* buffer */ { /* length */ 0, /* position */ 0, /* scan */ 0, /* overrun */ FALSE, /* data */ NULL, /* ring */ NULL, },
+        /* output */ { /* length */ 0, /* rd */ 0, /* wr */ 0, /* message */ 0, /* overflow */ FALSE, /* pipeline */ TRUE, /* data */ NULL, /* ring */ NULL, /* terminator */ "\r\n", /* terminator_len */ 2,
+                     /* spill */ NULL, /* spill_rd */ 0, /* spill_len */ 0, /* spill_size */ 0, },
+        /* paramlist */ { /* cmd */ NULL, /* parameters */ NULL, /* length */ 0, },
+        /* output_count */ 0,
+        /* input_count */ 0,
+        /* cmd_error */ FALSE,
+        /* error_queue */ NULL,
+        /* registers */ scpi_regs,
+        /* user_context */ NULL,
+        /* stream */ { /* producer */ NULL, /* user_context */ NULL, },
+        /* parse */ { /* rest */ NULL, /* end */ NULL, /* prev */ NULL, /* prev_len */ 0, },
+    };
+};
+
+/* default sizes of SCPISession, input buffer and error queue as in the former
+ * SCPIParser; sessions under 1 KiB use a smaller SCPIBasicSession */
+#ifndef SCPI_INPUT_BUFFER_LENGTH
+#define SCPI_INPUT_BUFFER_LENGTH 256
+#endif
+
+#ifndef SCPI_OUTPUT_QUEUE_LENGTH
+#define SCPI_OUTPUT_QUEUE_LENGTH 256
+#endif
+
+/* storage of SCPIBasicSession, constructed before SCPICore uses it */
+template<size_t InputLen, size_t ErrorQueueLen, size_t OutputLen>
+struct scpi_session_storage_t {
+    char input_buffer[InputLen];
+    SCPICore::_fifo_slot_t error_slots[ErrorQueueLen];
+    char output_queue[OutputLen];
+};
+
+/*
+ * Session with input buffer of InputLen bytes (longest command line is
+ * InputLen - 1), error queue of ErrorQueueLen entries (power of two, the
+ * last one is Queue overflow) and output queue of OutputLen bytes, all
+ * inside the object. Small devices and servers share one code base, each
+ * session type with its own footprint, e.g.
+ * static SCPIBasicSession<64, 4, 64> session(&instrument);
+ */
+template<size_t InputLen, size_t ErrorQueueLen, size_t OutputLen>
+class SCPIBasicSession : private scpi_session_storage_t<InputLen, ErrorQueueLen, OutputLen>, public SCPICore
+{
+    static_assert(InputLen >= 2, "input buffer needs room for a terminator");
+    static_assert(ErrorQueueLen >= 2 && (ErrorQueueLen & (ErrorQueueLen - 1)) == 0, "error queue length must be power of two, at least 2");
+    static_assert(OutputLen > 0, "output queue must not be empty");
+
+    typedef scpi_session_storage_t<InputLen, ErrorQueueLen, OutputLen> storage_t;
+
+public:
+    explicit SCPIBasicSession(const scpi_instrument_t * instrument = NULL) :
+        storage_t(),
+        SCPICore(instrument, storage_t::input_buffer, InputLen, storage_t::error_slots, ErrorQueueLen, storage_t::output_queue, OutputLen)
+    {
+    }
+};
+
+typedef SCPIBasicSession<SCPI_INPUT_BUFFER_LENGTH, FIFO_SIZE, SCPI_OUTPUT_QUEUE_LENGTH> SCPISession;
+
+#endif // SCPICORE_H
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Parser core without Qt, included by the library,
+# the servers and the Qt application
+#
+#-------------------------------------------------
+
+INCLUDEPATH += $$PWD
+
+# coroutine command handlers, the whole project is built as C++20
+scpi_coroutines {
+    CONFIG += c++2a
+    DEFINES += SCPI_USE_COROUTINES=1
+}
+
+SOURCES += \
+    $$PWD/scpicore.cpp \
+    $$PWD/scpiworkerpool.cpp \
+    $$PWD/scpi.cpp \
+    $$PWD/utils.cpp
+
+HEADERS += \
+    $$PWD/scpicore.h \
+    $$PWD/scpi.h \
+    $$PWD/types.h \
+    $$PWD/config.h \
+    $$PWD/constants.h \
+    $$PWD/error.h \
+    $$PWD/ieee488.h \
+    $$PWD/utils_private.h \
+    $$PWD/fifo.h \
+    $$PWD/scpicoroutine.h \
+    $$PWD/scpibind.h \
+    $$PWD/scpiworkerpool.h
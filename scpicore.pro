@@ -0,0 +1,15 @@
+#-------------------------------------------------
+#
+# Parser core library with C interface (scpi.h), no Qt
+# Shared library by CONFIG -= staticlib
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+CONFIG   += staticlib
+
+TARGET = scpicore
+
+TEMPLATE = lib
+
+include(scpicore.pri)
@@ -0,0 +1,87 @@
+/**
+ * @file   scpicoroutine.h
+ *
+ * @brief  Coroutine command handlers
+ *
+ * Command handler can be a coroutine returning scpi_task_t. It runs like
+ * a normal callback until it awaits an event that is not set yet. Then the
+ * session is held (like by *WAI) but the thread is free to serve other
+ * sessions. When the event is set, the coroutine is resumed by
+ * SCPI_OperationSync on the session thread and the command is finished
+ * when the coroutine returns.
+ *
+ * Requires C++20, enable with -DSCPI_USE_COROUTINES=1 for all sources
+ * (see config.h)
+ */
+
+#ifndef SCPI_COROUTINE_H
+#define	SCPI_COROUTINE_H
+
+#include "config.h"
+
+#if SCPI_USE_COROUTINES
+
+#if !defined(__cpp_impl_coroutine)
+#error "SCPI_USE_COROUTINES requires C++20 coroutines"
+#endif
+
+#include <coroutine>
+#include <atomic>
+
+class SCPICore;
+
+/* result of coroutine command handler, frame is owned by the parser */
+struct scpi_task_t {
+    struct promise_type {
+        SCPICore * parser;
+        scpi_result_t result;
+
+        /* handler has to be member of SCPICore (or derived class),
+         * parser is the implicit object */
+        template <typename Parser, typename... Args>
+        promise_type(Parser & p, Args &...) : parser(&p), result(SCPI_RES_OK) {}
+
+        scpi_task_t get_return_object() {
+            return scpi_task_t{std::coroutine_handle<promise_type>::from_promise(*this)};
+        }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        void return_value(scpi_result_t value) { result = value; }
+        void unhandled_exception() { result = SCPI_RES_ERR; }
+    };
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+/* one shot event awaited by coroutine handler, set from any thread
+ * (interrupt, driver thread). Event is rearmed when the awaiting
+ * coroutine continues. */
+struct scpi_event_t {
+    enum { IDLE = 0, WAITING, SET };
+
+    std::atomic<int> state;
+    SCPICore * parser;
+
+    scpi_event_t() : state(IDLE), parser(nullptr) {}
+
+    bool await_ready() const noexcept {
+        return state.load(std::memory_order_acquire) == SET;
+    }
+
+    bool await_suspend(std::coroutine_handle<scpi_task_t::promise_type> handle) noexcept {
+        int expected = IDLE;
+        parser = handle.promise().parser;
+        /* event set meanwhile - continue without suspending */
+        return state.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel);
+    }
+
+    void await_resume() noexcept {
+        state.store(IDLE, std::memory_order_relaxed);
+    }
+
+    void set();
+};
+
+#endif /* SCPI_USE_COROUTINES */
+
+#endif	/* SCPI_COROUTINE_H */
@@ -0,0 +1,161 @@
+#include "scpidevicebinding.h"
+
+SCPIDeviceBinding::SCPIDeviceBinding(SCPIParser * session, QIODevice * device, QObject * parent) :
+    QObject(parent),
+    parser(session),
+    io(device),
+    busy(false),
+    input_full(false),
+    write_queued(false)
+{
+    executor.ready.store(NULL);
+    executor.notify = executorNotify;
+    executor.user_context = this;
+    parser->SCPI_ExecutorAttach(&executor);
+
+    connect(io, &QIODevice::readyRead, this, &SCPIDeviceBinding::readInput);
+    connect(io, &QIODevice::bytesWritten, this, &SCPIDeviceBinding::deviceWritten);
+    connect(parser, &SCPIParser::statusChanged, this, &SCPIDeviceBinding::sessionStatus);
+
+    /* data received before the binding do not signal readyRead again */
+    if (io->bytesAvailable() > 0) {
+        QMetaObject::invokeMethod(this, "readInput", Qt::QueuedConnection);
+    }
+}
+
+SCPIDeviceBinding::~SCPIDeviceBinding()
+{
+    parser->SCPI_ExecutorAttach(NULL);
+}
+
+SCPIParser * SCPIDeviceBinding::session() const {
+    return parser;
+}
+
+QIODevice * SCPIDeviceBinding::device() const {
+    return io;
+}
+
+/**
+ * Read available data directly to the input buffer and write responses of
+ * every read batch. If the buffer is full, reading continues after the
+ * responses are written.
+ */
+void SCPIDeviceBinding::readInput() {
+    char * buffer;
+    size_t room;
+    qint64 received;
+
+    if (busy) {
+        return;
+    }
+
+    busy = true;
+    for (;;) {
+        buffer = parser->SCPI_InputBuffer(&room);
+        if (room == 0) {
+            input_full = true;
+            break;
+        }
+
+        received = io->read(buffer, room);
+        if (received <= 0) {
+            input_full = false;
+            break;
+        }
+        parser->SCPI_InputCommit(received);
+        flushOutput();
+    }
+    busy = false;
+}
+
+/**
+ * Write responses from output queue and continue reading if the input
+ * waited for them
+ */
+void SCPIDeviceBinding::writeOutput() {
+    write_queued = false;
+    if (busy) {
+        return;
+    }
+
+    busy = true;
+    flushOutput();
+    busy = false;
+
+    if (input_full) {
+        readInput();
+    }
+}
+
+/**
+ * Apply operations completed on other threads, answer *OPC? and continue
+ * commands held by *WAI
+ */
+void SCPIDeviceBinding::runSession() {
+    if (busy) {
+        return;
+    }
+
+    busy = true;
+    SCPIParser::SCPI_ExecutorRun(&executor);
+    flushOutput();
+    busy = false;
+
+    if (input_full) {
+        readInput();
+    }
+}
+
+/**
+ * Write all complete responses by one write. Reading the queue lets the
+ * session continue with next program message, its responses follow by
+ * next write.
+ */
+void SCPIDeviceBinding::flushOutput() {
+    const char * data;
+    size_t len;
+    qint64 written;
+
+    while (io->bytesToWrite() < SCPI_DEVICE_WRITE_LIMIT) {
+        len = parser->SCPI_OutputPeek(&data);
+        if (len == 0) {
+            break;
+        }
+
+        written = io->write(data, len);
+        if (written <= 0) {
+            break;
+        }
+        parser->SCPI_OutputConsume(written);
+    }
+}
+
+void SCPIDeviceBinding::deviceWritten(qint64 bytes) {
+    (void) bytes;
+    if (parser->SCPI_OutputCount() > 0 || input_full) {
+        writeOutput();
+    }
+}
+
+/**
+ * Response produced outside of the binding (by the application or a timer)
+ * is written from the event loop, not from inside the session
+ * @param stb - status byte
+ * @param changed - changed bits
+ */
+void SCPIDeviceBinding::sessionStatus(int stb, int changed) {
+    if (busy || write_queued || !(changed & stb & STB_MAV)) {
+        return;
+    }
+    write_queued = true;
+    QMetaObject::invokeMethod(this, "writeOutput", Qt::QueuedConnection);
+}
+
+/**
+ * Called by the session from any thread when it has completed operations
+ * @param user_context - binding
+ */
+void SCPIDeviceBinding::executorNotify(void * user_context) {
+    QMetaObject::invokeMethod((SCPIDeviceBinding *) user_context, "runSession", Qt::QueuedConnection);
+}
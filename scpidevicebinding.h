@@ -0,0 +1,68 @@
+/**
+ * @file   scpidevicebinding.h
+ *
+ * @brief  Serve parser session through QIODevice (QTcpSocket,
+ *         QSerialPort, QLocalSocket, ...) in Qt event loop
+ *
+ * Received data are read by the device directly to the input buffer of the
+ * session, without QByteArray in between. Complete responses are taken from
+ * the output queue by one write, so pipelined session writes once per
+ * program message. Operations completed on other threads are applied on the
+ * thread of the binding through its executor.
+ */
+
+#ifndef SCPIDEVICEBINDING_H
+#define SCPIDEVICEBINDING_H
+
+#include <QObject>
+#include <QIODevice>
+
+#include "scpiparser.h"
+
+/* bytes waiting in the device before responses are held in output queue,
+ * session then waits until the device writes them */
+#ifndef SCPI_DEVICE_WRITE_LIMIT
+#define SCPI_DEVICE_WRITE_LIMIT (64 * 1024)
+#endif
+
+class SCPIDeviceBinding : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Attach session to the device, both have to live in the thread of the
+     * binding. Overlapped operations of the session have to be finished
+     * before the binding is destroyed.
+     * @param session
+     * @param device - opened device
+     * @param parent
+     */
+    SCPIDeviceBinding(SCPIParser * session, QIODevice * device, QObject * parent = 0);
+    ~SCPIDeviceBinding();
+
+    SCPIParser * session() const;
+    QIODevice * device() const;
+
+public slots:
+    void readInput();
+    void writeOutput();
+    void runSession();
+
+private slots:
+    void deviceWritten(qint64 bytes);
+    void sessionStatus(int stb, int changed);
+
+private:
+    SCPIParser * parser;
+    QIODevice * io;
+    scpi_executor_t executor;
+    bool busy;
+    bool input_full;
+    bool write_queued;
+
+    void flushOutput();
+    static void executorNotify(void * user_context);
+};
+
+#endif // SCPIDEVICEBINDING_H
@@ -0,0 +1,331 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <new>
+
+#include "scpishm.h"
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex needs plain 32 bit word");
+
+static void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+/**
+ * Ring the doorbell of the other side, wake it up if it sleeps
+ * @param bell
+ * @param sleeping
+ */
+static void bellRing(std::atomic<uint32_t> * bell, std::atomic<uint32_t> * sleeping) {
+    bell->fetch_add(1);
+    if (sleeping->load()) {
+        syscall(SYS_futex, bell, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Spin and then sleep until the doorbell is rung
+ * @param bell
+ * @param sleeping
+ * @param seen - value of the bell before the condition was checked
+ * @param timeout_ms - maximum sleep, negative for infinite
+ */
+static void bellWait(std::atomic<uint32_t> * bell, std::atomic<uint32_t> * sleeping, uint32_t seen, int timeout_ms) {
+    /* on single core the other side cannot run while we spin */
+    static const int spin = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? SCPI_SHM_SPIN : 0;
+    struct timespec timeout;
+    int i;
+
+    for (i = 0; i < spin; i++) {
+        if (bell->load(std::memory_order_acquire) != seen) {
+            return;
+        }
+        cpuRelax();
+    }
+
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000L;
+
+    /* ringing side checks the flag after the bell, one of them sees the other */
+    sleeping->store(1);
+    if (bell->load() == seen) {
+        syscall(SYS_futex, bell, FUTEX_WAIT, seen, (timeout_ms < 0) ? NULL : &timeout, NULL, 0);
+    }
+    sleeping->store(0, std::memory_order_relaxed);
+}
+
+SCPISharedMemory::SCPISharedMemory() :
+    header(NULL),
+    command(NULL),
+    response(NULL),
+    size(0),
+    name(NULL)
+{
+}
+
+SCPISharedMemory::~SCPISharedMemory()
+{
+    close();
+}
+
+/**
+ * Map header and both rings of the segment, every ring twice back to back
+ * @param fd - segment
+ * @return 0 on success, -1 on error
+ */
+int SCPISharedMemory::map(int fd) {
+    size_t total = SCPI_SHM_HEADER + 4 * size;
+    char * base;
+    int i;
+
+    /* reserve continuous address space, then place the parts into it */
+    base = (char *) mmap(NULL, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    if (mmap(base, SCPI_SHM_HEADER, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(base, total);
+        return -1;
+    }
+    for (i = 0; i < 4; i++) {
+        off_t offset = SCPI_SHM_HEADER + (i / 2) * size;
+        if (mmap(base + SCPI_SHM_HEADER + i * size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offset) == MAP_FAILED) {
+            munmap(base, total);
+            return -1;
+        }
+    }
+
+    header = (header_t *) base;
+    command = base + SCPI_SHM_HEADER;
+    response = base + SCPI_SHM_HEADER + 2 * size;
+    return 0;
+}
+
+/**
+ * Create segment for the service. Segment left by previous service of the
+ * same name is replaced.
+ * @param name - POSIX shared memory name, e.g. "/scpi"
+ * @param size - size of each ring, power of two and multiple of page size
+ * @return 0 on success, -1 on error
+ */
+int SCPISharedMemory::create(const char * name, size_t size) {
+    int fd;
+
+    close();
+    if (size == 0 || (size & (size - 1)) != 0 || (size % SCPI_SHM_HEADER) != 0 || size > 0x80000000u) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    shm_unlink(name);
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        return -1;
+    }
+    this->size = size;
+    if (ftruncate(fd, SCPI_SHM_HEADER + 2 * size) < 0 || map(fd) < 0) {
+        ::close(fd);
+        shm_unlink(name);
+        this->size = 0;
+        return -1;
+    }
+    ::close(fd);
+
+    new (header) header_t();
+    header->size = size;
+    /* client accepts the segment only with magic set */
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = SCPI_SHM_MAGIC;
+    this->name = strdup(name);
+    return 0;
+}
+
+/**
+ * Open segment created by the service
+ * @param name - POSIX shared memory name
+ * @return 0 on success, -1 on error
+ */
+int SCPISharedMemory::open(const char * name) {
+    struct stat st;
+    int fd;
+
+    close();
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size <= SCPI_SHM_HEADER) {
+        ::close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    size = (st.st_size - SCPI_SHM_HEADER) / 2;
+    if (map(fd) < 0) {
+        ::close(fd);
+        size = 0;
+        return -1;
+    }
+    ::close(fd);
+
+    if (header->magic != SCPI_SHM_MAGIC || header->size != size) {
+        close();
+        errno = EINVAL;
+        return -1;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return 0;
+}
+
+/**
+ * Unmap the segment, service also removes its name
+ */
+void SCPISharedMemory::close() {
+    if (header != NULL) {
+        munmap(header, SCPI_SHM_HEADER + 4 * size);
+    }
+    if (name != NULL) {
+        shm_unlink(name);
+        free(name);
+    }
+    header = NULL;
+    command = NULL;
+    response = NULL;
+    size = 0;
+    name = NULL;
+}
+
+/**
+ * Get free continuous part of the command ring
+ * @param len - number of bytes available
+ * @return first free byte
+ */
+char * SCPISharedMemory::commandBuffer(size_t * len) {
+    uint32_t wr = header->command_wr.load(std::memory_order_relaxed);
+    uint32_t rd = header->command_rd.load(std::memory_order_acquire);
+
+    /* one byte less, parser keeps the last one of its buffer free */
+    *len = size - 1 - (wr - rd);
+    return command + (wr & (size - 1));
+}
+
+/**
+ * Pass bytes written to the buffer from commandBuffer to the service
+ * @param len - number of bytes
+ */
+void SCPISharedMemory::commandCommit(size_t len) {
+    header->command_wr.store(header->command_wr.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    bellRing(&header->service_bell, &header->service_sleeping);
+}
+
+/**
+ * Get responses published by the service without copying them
+ * @param data - first unread byte
+ * @return number of continuous bytes available at *data
+ */
+size_t SCPISharedMemory::responsePeek(const char ** data) {
+    uint32_t rd = header->response_rd.load(std::memory_order_relaxed);
+    uint32_t wr = header->response_wr.load(std::memory_order_acquire);
+
+    *data = response + (rd & (size - 1));
+    return wr - rd;
+}
+
+/**
+ * Mark responses as read, the service can continue with waiting commands
+ * @param len - number of bytes
+ */
+void SCPISharedMemory::responseConsume(size_t len) {
+    header->response_rd.store(header->response_rd.load(std::memory_order_relaxed) + len, std::memory_order_release);
+    bellRing(&header->service_bell, &header->service_sleeping);
+}
+
+/**
+ * Wait for responses
+ * @param data - first unread byte
+ * @param timeout_ms - maximum time to sleep, negative for infinite
+ * @return number of continuous bytes available at *data, 0 on timeout
+ */
+size_t SCPISharedMemory::responseWait(const char ** data, int timeout_ms) {
+    uint32_t seen = header->client_bell.load();
+    size_t len = responsePeek(data);
+
+    if (len == 0) {
+        bellWait(&header->client_bell, &header->client_sleeping, seen, timeout_ms);
+        len = responsePeek(data);
+    }
+    return len;
+}
+
+char * SCPISharedMemory::commandRing() {
+    return command;
+}
+
+char * SCPISharedMemory::responseRing() {
+    return response;
+}
+
+size_t SCPISharedMemory::ringSize() {
+    return size;
+}
+
+/**
+ * @return position behind the last command byte written by the client
+ */
+uint32_t SCPISharedMemory::commandWritten() {
+    return header->command_wr.load(std::memory_order_acquire);
+}
+
+/**
+ * Give processed part of the command ring back to the client
+ * @param rd - position behind the last processed byte
+ */
+void SCPISharedMemory::commandRelease(uint32_t rd) {
+    if (header->command_rd.load(std::memory_order_relaxed) != rd) {
+        header->command_rd.store(rd, std::memory_order_release);
+    }
+}
+
+/**
+ * @return position behind the last response byte read by the client
+ */
+uint32_t SCPISharedMemory::responseRead() {
+    return header->response_rd.load(std::memory_order_acquire);
+}
+
+/**
+ * Publish responses written to the response ring and wake up the client
+ * @param wr - position behind the last written byte
+ */
+void SCPISharedMemory::responsePublish(uint32_t wr) {
+    if (header->response_wr.load(std::memory_order_relaxed) != wr) {
+        header->response_wr.store(wr, std::memory_order_release);
+        bellRing(&header->client_bell, &header->client_sleeping);
+    }
+}
+
+/**
+ * Get doorbell of the service, read before the rings are checked and
+ * passed to serviceWait
+ * @return bell value
+ */
+uint32_t SCPISharedMemory::serviceBell() {
+    return header->service_bell.load();
+}
+
+/**
+ * Wait until the client commits commands or reads responses
+ * @param seen - value returned by serviceBell
+ */
+void SCPISharedMemory::serviceWait(uint32_t seen) {
+    bellWait(&header->service_bell, &header->service_sleeping, seen, -1);
+}
@@ -0,0 +1,91 @@
+/**
+ * @file   scpishm.h
+ *
+ * @brief  Shared memory transport between instrument service and a client
+ *         on the same host
+ *
+ * POSIX shared memory segment holds a command ring (client to service) and
+ * a response ring (service to client). Both are single producer, single
+ * consumer byte rings with free running 32 bit positions. Every ring is
+ * mapped twice back to back, so any part of it is continuous: service
+ * parses commands in place and writes responses directly to the ring.
+ * Each side spins shortly for the other one and then sleeps on its futex
+ * doorbell.
+ *
+ * Does not depend on the parser, client links only this module.
+ */
+
+#ifndef SCPISHM_H
+#define SCPISHM_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+/* size of each ring, power of two and multiple of page size */
+#ifndef SCPI_SHM_RING_SIZE
+#define SCPI_SHM_RING_SIZE (64 * 1024)
+#endif
+
+/* number of polls before the waiting side sleeps, no polling on single core */
+#ifndef SCPI_SHM_SPIN
+#define SCPI_SHM_SPIN 4000
+#endif
+
+#define SCPI_SHM_HEADER 4096
+#define SCPI_SHM_MAGIC 0x53435049
+
+class SCPISharedMemory
+{
+public:
+    SCPISharedMemory();
+    ~SCPISharedMemory();
+
+    int create(const char * name, size_t size = SCPI_SHM_RING_SIZE);
+    int open(const char * name);
+    void close();
+
+    /* client side */
+    char * commandBuffer(size_t * len);
+    void commandCommit(size_t len);
+    size_t responsePeek(const char ** data);
+    void responseConsume(size_t len);
+    size_t responseWait(const char ** data, int timeout_ms);
+
+    /* service side */
+    char * commandRing();
+    char * responseRing();
+    size_t ringSize();
+    uint32_t commandWritten();
+    void commandRelease(uint32_t rd);
+    uint32_t responseRead();
+    void responsePublish(uint32_t wr);
+    uint32_t serviceBell();
+    void serviceWait(uint32_t seen);
+
+private:
+    /* segment header, positions of each ring are written by one side
+     * bell, sleeping - futex doorbell of the side and its sleep flag */
+    struct header_t {
+        uint32_t magic;
+        uint32_t size;
+        alignas(64) std::atomic<uint32_t> command_wr;
+        alignas(64) std::atomic<uint32_t> command_rd;
+        alignas(64) std::atomic<uint32_t> response_wr;
+        alignas(64) std::atomic<uint32_t> response_rd;
+        alignas(64) std::atomic<uint32_t> service_bell;
+        std::atomic<uint32_t> service_sleeping;
+        alignas(64) std::atomic<uint32_t> client_bell;
+        std::atomic<uint32_t> client_sleeping;
+    };
+
+    header_t * header;
+    char * command;
+    char * response;
+    size_t size;
+    char * name;
+
+    int map(int fd);
+};
+
+#endif // SCPISHM_H
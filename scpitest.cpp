@@ -0,0 +1,726 @@
+/**
+ * @file   scpitest.cpp
+ *
+ * @brief  Checks of the parser core, responses are read back through the
+ *         output queue as a transport reads them
+ *
+ * Usage: scpi-test, exit status is the number of failed checks
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+#include "scpiworkerpool.h"
+#include "scpibind.h"
+#include "scpi.h"
+
+static int test_failed;
+
+#define TEST_CHECK(cond) testCheck((cond), #cond, __FILE__, __LINE__)
+
+static void testCheck(bool cond, const char * text, const char * file, int line) {
+    if (!cond) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, text);
+        test_failed++;
+    }
+}
+
+#if SCPI_USE_COROUTINES
+static scpi_event_t test_adc;
+#endif
+
+class TestSession : public SCPISession
+{
+public:
+    TestSession(const scpi_instrument_t * instrument) : SCPISession(instrument), token(-1), stream_pos(0) {
+        SCPI_Init();
+    }
+
+    /* send program message, return everything in the output queue */
+    std::string query(const char * message) {
+        std::string response;
+        const char * data;
+        size_t len;
+
+        SCPI_Input(message, strlen(message));
+        while ((len = SCPI_OutputPeek(&data)) > 0) {
+            response.append(data, len);
+            SCPI_OutputConsume(len);
+        }
+        return response;
+    }
+
+    scpi_result_t DataQ() {
+        SCPI_ResultArbitraryBlock("ABC\0EF", 6);
+        return SCPI_RES_OK;
+    }
+
+    scpi_result_t BigQ() {
+        char data[1000];
+        size_t i;
+
+        for (i = 0; i < sizeof (data); i++) {
+            data[i] = 'a' + i % 26;
+        }
+        SCPI_ResultArbitraryBlock(data, sizeof (data));
+        return SCPI_RES_OK;
+    }
+
+    /* overlapped command, finished by SCPI_OperationComplete(token) */
+    scpi_result_t Slow() {
+        token = SCPI_OperationBegin();
+        return SCPI_RES_PENDING;
+    }
+
+    scpi_result_t TwoQ() {
+        SCPI_ResultInt(1);
+        SCPI_ResultArbitraryBlock("xyz", 3);
+        return SCPI_RES_OK;
+    }
+
+    /* streamed result of STREAM_LENGTH bytes, pulled in chunks of at most
+     * 100 bytes */
+    scpi_result_t StreamQ() {
+        stream_pos = 0;
+        SCPI_ResultStream(static_cast<scpi_stream_producer_t>(&TestSession::streamChunk), NULL);
+        return SCPI_RES_OK;
+    }
+
+    size_t streamChunk(const char ** data, size_t len, void * user_context) {
+        static char chunk[100];
+        size_t i;
+
+        (void) user_context;
+        len = (len < sizeof (chunk)) ? len : sizeof (chunk);
+        len = (len < STREAM_LENGTH - stream_pos) ? len : STREAM_LENGTH - stream_pos;
+        for (i = 0; i < len; i++) {
+            chunk[i] = '0' + (stream_pos + i) % 10;
+        }
+        stream_pos += len;
+        *data = chunk;
+        return len;
+    }
+
+    enum { STREAM_LENGTH = 1000 };
+
+#if SCPI_USE_COROUTINES
+    /* measurement finished by test_adc */
+    scpi_task_t MeasQ() {
+        int32_t channel = 0;
+
+        SCPI_ParamInt(&channel, TRUE);
+        co_await test_adc;
+        SCPI_ResultInt(channel * 10);
+        co_return SCPI_RES_OK;
+    }
+#endif
+
+    int token;
+    size_t stream_pos;
+};
+
+static const char * test_ranges[] = {"LOW", "HIGH", NULL};
+static scpi_setting_t test_range(SCPI_Choice(test_ranges, 5));
+static scpi_setting_t test_volt(SCPI_Number(SCPI_UNIT_VOLT, 0, 30, 1));
+
+#define TEST_CMD(pattern, method) {pattern, static_cast<SCPICore::scpi_command_callback_t>(&TestSession::method),}
+#define TEST_COROUTINE(pattern, method) {pattern, NULL, static_cast<SCPICore::scpi_coroutine_callback_t>(&TestSession::method),}
+
+static const SCPICore::scpi_command_t test_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    TEST_CMD("BIG?", BigQ),
+    TEST_CMD("DATA?", DataQ),
+    TEST_CMD("TWO?", TwoQ),
+    TEST_CMD("SLOW", Slow),
+    TEST_CMD("STReam?", StreamQ),
+#if SCPI_USE_COROUTINES
+    TEST_COROUTINE("MEASure?", MeasQ),
+#endif
+    SCPI_SETTING("RANGe", test_range),
+    SCPI_SETTING("SOURce:VOLTage", test_volt),
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t test_instrument;
+
+/* block data are queued with the rest of the response */
+static void testBlock() {
+    TestSession session(&test_instrument);
+
+    TEST_CHECK(session.query("DATA?\n") == std::string("#16ABC\0EF\r\n", 11));
+    TEST_CHECK(session.query("TWO?\n") == "1, #13xyz\r\n");
+}
+
+/* block bigger than the output queue is read as a whole, in order with
+ * following responses */
+static void testBlockBig() {
+    TestSession session(&test_instrument);
+    std::string expected = "#41000";
+    std::string response;
+    char buffer[100];
+    size_t i;
+
+    for (i = 0; i < 1000; i++) {
+        expected += (char) ('a' + i % 26);
+    }
+    expected += "\r\n";
+
+    TEST_CHECK(session.query("BIG?\n") == expected);
+    TEST_CHECK(session.query("BIG?\nDATA?\n") == expected + std::string("#16ABC\0EF\r\n", 11));
+
+    /* read requests smaller than the queue */
+    session.SCPI_Input("BIG?\n", 5);
+    TEST_CHECK(session.SCPI_OutputCount() == expected.size());
+    while (session.SCPI_OutputCount() > 0) {
+        i = session.SCPI_OutputRead(buffer, sizeof (buffer));
+        response.append(buffer, i);
+    }
+    TEST_CHECK(response == expected);
+    TEST_CHECK(session.query("SYST:ERR?\n") == "0,\"No error\"\r\n");
+}
+
+/* SYSTem:ERRor:ALL? returns only errors fitting into the output queue */
+static void testErrorAll() {
+    TestSession session(&test_instrument);
+    std::string response;
+    int queries = 0;
+    int errors = 0;
+    size_t pos;
+    int i;
+
+    for (i = 0; i < 12; i++) {
+        session.SCPI_ErrorPushEx(SCPI_ERROR_EXECUTION_ERROR, "detail text of the error", 24);
+    }
+
+    for (;;) {
+        response = session.query("SYST:ERR:ALL?\n");
+        TEST_CHECK(response.size() > 2 && response.compare(response.size() - 2, 2, "\r\n") == 0);
+        TEST_CHECK(response.find("-430") == std::string::npos);
+        if (response.compare(0, 2, "0,") == 0 || queries > 12) {
+            break;
+        }
+        for (pos = 0; (pos = response.find("-200,", pos)) != std::string::npos; pos++) {
+            errors++;
+        }
+        queries++;
+    }
+
+    TEST_CHECK(errors == 12);
+    TEST_CHECK(queries > 1);
+}
+
+/* quotes in detail text are doubled in the string response */
+static void testErrorQuote() {
+    TestSession session(&test_instrument);
+
+    session.SCPI_ErrorPushEx(SCPI_ERROR_EXECUTION_ERROR, "say \"hi\"", 8);
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-200,\"Execution error;say \"\"hi\"\"\"\r\n");
+}
+
+/* Queue overflow takes the last entry of the error queue */
+static void testErrorOverflow() {
+    SCPIBasicSession<64, 4, 64> session(&test_instrument);
+    SCPICore::scpi_error_t error;
+    int i;
+
+    session.SCPI_Init();
+    for (i = 0; i < 10; i++) {
+        session.SCPI_ErrorPushEx(SCPI_ERROR_EXECUTION_ERROR + i, NULL, 0);
+    }
+    TEST_CHECK(session.SCPI_ErrorCount() == 4);
+
+    for (i = 0; i < 3; i++) {
+        TEST_CHECK(session.SCPI_ErrorPopEx(&error) && error.code == SCPI_ERROR_EXECUTION_ERROR + i);
+    }
+    TEST_CHECK(session.SCPI_ErrorCount() == 1);
+    TEST_CHECK(session.SCPI_ErrorPopEx(&error) && error.code == SCPI_ERROR_QUEUE_OVERFLOW);
+    TEST_CHECK(!session.SCPI_ErrorPopEx(&error) && session.SCPI_ErrorCount() == 0);
+}
+
+/* *OPC? answers when overlapped command completes, reading before is
+ * not Query UNTERMINATED */
+static void testOpcQuery() {
+    TestSession session(&test_instrument);
+    char buffer[16];
+
+    session.SCPI_Input("SLOW;*OPC?\n", 11);
+    TEST_CHECK(session.token >= 0);
+    TEST_CHECK(session.SCPI_OutputRead(buffer, sizeof (buffer)) == 0);
+
+    session.SCPI_OperationComplete(session.token);
+    TEST_CHECK(session.query("") == "1\r\n");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "0,\"No error\"\r\n");
+
+    /* nothing was asked */
+    TEST_CHECK(session.SCPI_OutputRead(buffer, sizeof (buffer)) == 0);
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-420,\"Query UNTERMINATED\"\r\n");
+}
+
+/* *OPC sets ESR OPC when overlapped commands complete, *WAI holds
+ * following commands until then */
+static void testOpcWai() {
+    TestSession session(&test_instrument);
+    int token;
+
+    TEST_CHECK(session.query("SLOW;*OPC;*ESR?\n") == "0\r\n");
+    session.SCPI_OperationComplete(session.token);
+    TEST_CHECK(session.query("*ESR?\n") == "1\r\n");
+
+    TEST_CHECK(session.query("SLOW;*WAI;*ESR?\n") == "");
+    token = session.token;
+    TEST_CHECK(session.query("*ESR?\n") == "");
+    session.SCPI_OperationComplete(token);
+    TEST_CHECK(session.query("") == "0\r\n0\r\n");
+}
+
+/* group without transition filters latches every positive transition */
+static const scpi_reg_group_t test_reg_groups[] = {
+    {/* condition */ SCPI_REG_OPERC, /* ptr */ SCPI_REG_COUNT, /* ntr */ SCPI_REG_COUNT,
+     /* event */ SCPI_REG_OPER, /* enable */ SCPI_REG_OPERE, /* parent */ SCPI_REG_STB, /* parent_bit */ STB_OPS},
+    SCPI_REG_GROUPS_LIST_END,
+};
+
+static void testRegFilterless() {
+    SCPICore::scpi_instrument_t instrument = test_instrument;
+    SCPICore::SCPI_InstrumentRegGroups(&instrument, test_reg_groups);
+    TestSession session(&instrument);
+
+    session.SCPI_RegSet(SCPI_REG_OPERE, 0x0003);
+    session.SCPI_RegSetBits(SCPI_REG_OPERC, 0x0001);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPER) == 0x0001);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_STB) & STB_OPS);
+
+    session.SCPI_RegClearBits(SCPI_REG_OPERC, 0x0001);
+    session.SCPI_RegSetBits(SCPI_REG_OPERC, 0x0002);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPER) == 0x0003);
+}
+
+/* summary of a sub-register goes through condition of its parent to STB */
+static const scpi_reg_group_t test_nested_groups[] = {
+    {/* condition */ SCPI_REG_QUESC, /* ptr */ SCPI_REG_COUNT, /* ntr */ SCPI_REG_COUNT,
+     /* event */ SCPI_REG_QUES, /* enable */ SCPI_REG_QUESE, /* parent */ SCPI_REG_OPERC, /* parent_bit */ 0x0100},
+    {/* condition */ SCPI_REG_OPERC, /* ptr */ SCPI_REG_OPERPTR, /* ntr */ SCPI_REG_OPERNTR,
+     /* event */ SCPI_REG_OPER, /* enable */ SCPI_REG_OPERE, /* parent */ SCPI_REG_STB, /* parent_bit */ STB_OPS},
+    SCPI_REG_GROUPS_LIST_END,
+};
+
+static void testRegNested() {
+    SCPICore::scpi_instrument_t instrument = test_instrument;
+    SCPICore::SCPI_InstrumentRegGroups(&instrument, test_nested_groups);
+    TestSession session(&instrument);
+
+    session.SCPI_RegSet(SCPI_REG_OPERE, 0x0100);
+    session.SCPI_RegSet(SCPI_REG_OPERNTR, 0x0100);
+    session.SCPI_RegSetBits(SCPI_REG_QUESC, 0x0001);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_QUES) == 0x0001);
+    TEST_CHECK(!(session.SCPI_RegGet(SCPI_REG_STB) & STB_OPS));
+
+    /* enabling the event raises the parent condition */
+    session.SCPI_RegSet(SCPI_REG_QUESE, 0x0001);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPERC) == 0x0100);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPER) == 0x0100);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_STB) & STB_OPS);
+
+    /* negative transition of the summary is latched by NTR */
+    session.SCPI_RegSet(SCPI_REG_OPER, 0);
+    session.SCPI_RegSet(SCPI_REG_QUES, 0);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPERC) == 0);
+    TEST_CHECK(session.SCPI_RegGet(SCPI_REG_OPER) == 0x0100);
+
+    session.SCPI_RegSet(SCPI_REG_OPER, 0);
+    TEST_CHECK(!(session.SCPI_RegGet(SCPI_REG_STB) & STB_OPS));
+}
+
+/* decimal numbers print every exponent digit and are always terminated */
+static void testDecimalToStr() {
+    char buffer[32];
+
+    TEST_CHECK(decimalToStr(15, 20, buffer, sizeof (buffer)) == 7 && strcmp(buffer, "1.5e+21") == 0);
+    TEST_CHECK(decimalToStr(1, 1000, buffer, sizeof (buffer)) == 7 && strcmp(buffer, "1e+1000") == 0);
+    TEST_CHECK(decimalToStr(-1, -1000, buffer, sizeof (buffer)) == 8 && strcmp(buffer, "-1e-1000") == 0);
+    TEST_CHECK(decimalToStr(1, INT16_MAX, buffer, sizeof (buffer)) == 8 && strcmp(buffer, "1e+32767") == 0);
+    TEST_CHECK(decimalToStr(25, -1, buffer, sizeof (buffer)) == 3 && strcmp(buffer, "2.5") == 0);
+
+    memset(buffer, 'x', sizeof (buffer));
+    TEST_CHECK(decimalToStr(123456, 0, buffer, 4) == 3 && strcmp(buffer, "123") == 0);
+    TEST_CHECK(decimalToStr(0, 0, buffer, 1) == 0 && buffer[0] == '\0');
+}
+
+/* choice setting stays within its options */
+static void testChoice() {
+    TestSession session(&test_instrument);
+    scpi_param_value_t value;
+
+    TEST_CHECK(session.query("RANG?\n") == "LOW\r\n");
+    TEST_CHECK(session.query("RANG HIGH;RANG?\n") == "HIGH\r\n");
+
+    value.integer = 2;
+    SCPICore::SCPI_SettingSet(&test_range, &value);
+    TEST_CHECK(session.query("RANG?\n") == "");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-200,\"Execution error\"\r\n");
+}
+
+static int test_volt_changed;
+
+static void testVoltChanged(scpi_setting_t * setting, void * user_context) {
+    (void) setting;
+    (void) user_context;
+    test_volt_changed++;
+}
+
+/* number setting: DEFault, MINimum/MAXimum, units and range, changed
+ * callback, readers see only whole values */
+static void testSetting() {
+    TestSession session(&test_instrument);
+    scpi_param_value_t value;
+    std::atomic<bool> stop(false);
+    int torn = 0;
+
+    test_volt.changed = testVoltChanged;
+    TEST_CHECK(session.query("SOUR:VOLT?\n") == "1\r\n");
+    TEST_CHECK(session.query("SOUR:VOLT MAX;VOLT?\n") == "30\r\n");
+    TEST_CHECK(session.query("SOUR:VOLT 2.5 V;VOLT?\n") == "2.5\r\n");
+    TEST_CHECK(session.query("SOUR:VOLT 2500 mV;VOLT?\n") == "2.5\r\n");
+    TEST_CHECK(test_volt_changed == 3);
+
+    SCPICore::SCPI_SettingGet(&test_volt, &value);
+    TEST_CHECK(value.number == 2.5);
+
+    TEST_CHECK(session.query("SOUR:VOLT 31\n") == "");
+    TEST_CHECK(session.query("SOUR:VOLT 1 A\n") == "");
+    TEST_CHECK(session.query("SOUR:VOLT?\n") == "2.5\r\n");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-222,\"Data out of range\"\r\n");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-131,\"Invalid suffix\"\r\n");
+    TEST_CHECK(test_volt_changed == 3);
+
+    /* writer on another thread alternates two values */
+    std::thread writer([&stop]() {
+        scpi_param_value_t next;
+        int i = 0;
+
+        while (!stop.load()) {
+            next.number = (i++ & 1) ? 1.0 / 3.0 : 20.0;
+            SCPICore::SCPI_SettingSet(&test_volt, &next);
+        }
+    });
+    for (int i = 0; i < 100000; i++) {
+        SCPICore::SCPI_SettingGet(&test_volt, &value);
+        if (value.number != 2.5 && value.number != 1.0 / 3.0 && value.number != 20.0) {
+            torn++;
+        }
+    }
+    stop.store(true);
+    writer.join();
+    TEST_CHECK(torn == 0);
+
+    test_volt.changed = NULL;
+    value.number = 1;
+    SCPICore::SCPI_SettingSet(&test_volt, &value);
+}
+
+/* streamed result is pulled as the transport reads, commands after it run
+ * when it ends */
+static void testStream() {
+    TestSession session(&test_instrument);
+    std::string expected;
+    size_t i;
+
+    for (i = 0; i < TestSession::STREAM_LENGTH; i++) {
+        expected += (char) ('0' + i % 10);
+    }
+    expected += "\r\n";
+
+    TEST_CHECK(session.query("STR?\n") == expected);
+    TEST_CHECK(session.query("STR?;DATA?\nTWO?\n") == expected + std::string("#16ABC\0EF\r\n", 11) + "1, #13xyz\r\n");
+
+    session.SCPI_Input("STR?\n", 5);
+    TEST_CHECK(!session.SCPI_InputIdle());
+    TEST_CHECK(session.query("") == expected);
+    TEST_CHECK(session.SCPI_InputIdle());
+    TEST_CHECK(session.query("SYST:ERR?\n") == "0,\"No error\"\r\n");
+}
+
+#if SCPI_USE_COROUTINES
+static int test_executor_notified;
+
+static void testExecutorNotify(void * user_context) {
+    (void) user_context;
+    test_executor_notified++;
+}
+
+/* suspended coroutine handler holds following commands until its event is
+ * set and the executor resumes it */
+static void testCoroutine() {
+    TestSession session(&test_instrument);
+    scpi_executor_t executor;
+
+    executor.ready.store(NULL);
+    executor.notify = testExecutorNotify;
+    executor.user_context = NULL;
+    session.SCPI_ExecutorAttach(&executor);
+
+    TEST_CHECK(session.query("MEAS? 3;*ESR?\nSYST:ERR?\n") == "");
+    TEST_CHECK(!session.SCPI_InputIdle());
+    TEST_CHECK(test_executor_notified == 0);
+
+    test_adc.set();
+    TEST_CHECK(test_executor_notified == 1);
+    TEST_CHECK(SCPICore::SCPI_ExecutorRun(&executor) == 1);
+    TEST_CHECK(session.query("") == "30\r\n0\r\n0,\"No error\"\r\n");
+    TEST_CHECK(session.SCPI_InputIdle());
+
+    /* event set before, handler does not suspend */
+    test_adc.set();
+    TEST_CHECK(session.query("MEAS? 1\n") == "10\r\n");
+    TEST_CHECK(test_executor_notified == 1);
+}
+#endif
+
+static int test_status_count;
+
+static void testStatusCallback(void * user_context, scpi_reg_val_t stb, scpi_reg_val_t changed) {
+    (void) user_context;
+    (void) stb;
+    (void) changed;
+    test_status_count++;
+}
+
+static uint32_t test_clock;
+
+static uint32_t testClock() {
+    return test_clock;
+}
+
+/* first change is delivered at once, next ones when the window closes */
+static void testStatusWindow() {
+    TestSession session(&test_instrument);
+
+    test_status_count = 0;
+    test_clock = UINT32_MAX - 1000;
+    session.SCPI_StatusClock(testClock);
+    session.SCPI_StatusSubscribe(testStatusCallback, NULL, STB_ESR);
+    session.SCPI_StatusWindow(20);
+    session.SCPI_RegSet(SCPI_REG_ESE, ESR_OPC);
+    TEST_CHECK(session.SCPI_StatusDispatch() == -1);
+
+    session.SCPI_RegSetBits(SCPI_REG_ESR, ESR_OPC);
+    TEST_CHECK(test_status_count == 1);
+
+    test_clock += 5;
+    session.SCPI_RegSet(SCPI_REG_ESR, 0);
+    TEST_CHECK(test_status_count == 1);
+    TEST_CHECK(session.SCPI_StatusDispatch() == 15);
+
+    test_clock += 14;
+    TEST_CHECK(session.SCPI_StatusDispatch() == 1);
+    TEST_CHECK(test_status_count == 1);
+
+    test_clock += 1;
+    TEST_CHECK(session.SCPI_StatusDispatch() == -1);
+    TEST_CHECK(test_status_count == 2);
+
+    /* window started by the last delivery, clock wraps around inside it */
+    test_clock = UINT32_MAX - 5;
+    session.SCPI_RegSetBits(SCPI_REG_ESR, ESR_OPC);
+    TEST_CHECK(test_status_count == 3);
+    test_clock += 10;
+    session.SCPI_RegSet(SCPI_REG_ESR, 0);
+    TEST_CHECK(test_status_count == 3);
+    TEST_CHECK(session.SCPI_StatusDispatch() == 10);
+    test_clock += 10;
+    TEST_CHECK(session.SCPI_StatusDispatch() == -1);
+    TEST_CHECK(test_status_count == 4);
+}
+
+static int test_ingress_notified;
+
+static void testIngressNotify(SCPICore * session, void * user_context) {
+    (void) session;
+    (void) user_context;
+    test_ingress_notified++;
+}
+
+/* line longer than the input buffer arriving through the ingress ring is
+ * discarded with Input buffer overrun, following lines are processed */
+static void testIngressOverrun() {
+    TestSession session(&test_instrument);
+    std::string line(300, 'x');
+
+    TEST_CHECK(session.SCPI_IngressAttach(testIngressNotify, NULL) == 0);
+    TEST_CHECK(session.SCPI_IngressPush(line.data(), line.size()) == line.size());
+    TEST_CHECK(session.SCPI_IngressPush("\nDATA?\n", 7) == 7);
+    TEST_CHECK(test_ingress_notified == 1);
+
+    session.SCPI_IngressDrain();
+    TEST_CHECK(session.query("") == std::string("#16ABC\0EF\r\n", 11));
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-363,\"Input buffer overrun\"\r\n");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "0,\"No error\"\r\n");
+
+    /* overrun line split over pushes, terminator in the last one */
+    TEST_CHECK(session.SCPI_IngressPush(line.data(), 200) == 200);
+    TEST_CHECK(session.SCPI_IngressPush(line.data(), 200) == 200);
+    TEST_CHECK(session.SCPI_IngressPush("x\nTWO?\n", 7) == 7);
+    TEST_CHECK(test_ingress_notified == 2);
+
+    session.SCPI_IngressDrain();
+    TEST_CHECK(session.query("") == "1, #13xyz\r\n");
+    TEST_CHECK(session.query("SYST:ERR?\n") == "-363,\"Input buffer overrun\"\r\n");
+}
+
+static std::mutex test_pool_lock;
+static std::string test_pool_output;
+
+static size_t testPoolWrite(SCPICore * session, const char * data, size_t len, void * user_context) {
+    std::lock_guard<std::mutex> guard(test_pool_lock);
+    (void) session;
+    (void) user_context;
+    test_pool_output.append(data, len);
+    return len;
+}
+
+/* wait until the pool wrote len bytes, return them */
+static std::string testPoolRead(size_t len) {
+    std::string response;
+    int i;
+
+    for (i = 0; i < 1000; i++) {
+        {
+            std::lock_guard<std::mutex> guard(test_pool_lock);
+            if (test_pool_output.size() >= len) {
+                response = test_pool_output;
+                test_pool_output.clear();
+                return response;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return test_pool_output;
+}
+
+static int testCVoltage(scpi_session_t * session) {
+    int32_t * voltage = (int32_t *) scpi_device_context(scpi_session_device(session));
+
+    return scpi_param_int(session, voltage, 1) ? SCPI_OK : SCPI_ERROR;
+}
+
+static int testCVoltageQ(scpi_session_t * session) {
+    int32_t * voltage = (int32_t *) scpi_device_context(scpi_session_device(session));
+
+    scpi_result_int(session, *voltage);
+    return SCPI_OK;
+}
+
+static int testCMeasureQ(scpi_session_t * session) {
+    scpi_result_int(session, 42);
+    return SCPI_OK;
+}
+
+static const scpi_handler_def_t test_c_handlers[] = {
+    {"SOURce:VOLTage", testCVoltage},
+    {"SOURce:VOLTage?", testCVoltageQ},
+    {"MEASure?", testCMeasureQ},
+    SCPI_HANDLERS_END
+};
+
+/* send program message through the C API, return the whole response */
+static std::string testCQuery(scpi_session_t * session, const char * message) {
+    std::string response;
+    const char * data;
+    size_t len;
+
+    scpi_input(session, message, strlen(message));
+    while ((len = scpi_output_peek(session, &data)) > 0) {
+        response.append(data, len);
+        scpi_output_consume(session, len);
+    }
+    return response;
+}
+
+/* device commands call their own handler, common commands are added */
+static void testCApi() {
+    int32_t voltage = 0;
+    scpi_device_t * device = scpi_device_new(test_c_handlers, &voltage);
+    scpi_session_t * session;
+
+    TEST_CHECK(device != NULL);
+    scpi_device_idn(device, "MAKER", "MODEL", "0", "1.0");
+    session = scpi_session_new(device, NULL);
+    TEST_CHECK(session != NULL);
+
+    TEST_CHECK(testCQuery(session, "SOUR:VOLT 5;VOLT?\n") == "5\r\n");
+    TEST_CHECK(voltage == 5);
+    TEST_CHECK(testCQuery(session, "MEAS?;:SOUR:VOLT?\n") == "42\r\n5\r\n");
+    TEST_CHECK(testCQuery(session, "*IDN?\n") == "MAKER, MODEL, 0, 1.0\r\n");
+    TEST_CHECK(testCQuery(session, "*ESE 4;*ESE?\n") == "4\r\n");
+    TEST_CHECK(testCQuery(session, "SYST:ERR?\n") == "0,\"No error\"\r\n");
+
+    scpi_session_free(session);
+    scpi_device_free(device);
+}
+
+/* pooled session executes units in order, overrun of the input buffer is
+ * reported by the worker */
+static void testPool() {
+    TestSession session(&test_instrument);
+    SCPIWorkerPool pool(1);
+    std::string expected = std::string("1, #13xyz\r\n#16ABC\0EF\r\n", 22);
+    char * buffer;
+    size_t len;
+
+    TEST_CHECK(session.SCPI_PoolAttach(&pool, testPoolWrite, NULL) == 0);
+
+    TEST_CHECK(session.SCPI_InputDispatch("TWO?\nDATA?\n", 12) == 2);
+    TEST_CHECK(testPoolRead(expected.size()) == expected);
+
+    buffer = session.SCPI_InputBuffer(&len);
+    memset(buffer, 'x', len);
+    TEST_CHECK(session.SCPI_InputCommit(len) == 0);
+    session.SCPI_InputBuffer(&len);
+    TEST_CHECK(session.SCPI_InputDispatch("\nSYST:ERR?\n*ESR?\n", 17) == 2);
+    expected = "-363,\"Input buffer overrun\"\r\n8\r\n";
+    TEST_CHECK(testPoolRead(expected.size()) == expected);
+}
+
+int main()
+{
+    SCPICore::SCPI_InstrumentInit(&test_instrument, test_commands);
+
+    testBlock();
+    testBlockBig();
+    testCApi();
+    testDecimalToStr();
+    testErrorAll();
+    testErrorQuote();
+    testErrorOverflow();
+    testOpcQuery();
+    testOpcWai();
+    testIngressOverrun();
+    testPool();
+    testChoice();
+    testSetting();
+    testStream();
+#if SCPI_USE_COROUTINES
+    testCoroutine();
+#endif
+    testRegFilterless();
+    testRegNested();
+    testStatusWindow();
+
+    if (test_failed == 0) {
+        printf("all checks passed\n");
+    }
+    return test_failed;
+}
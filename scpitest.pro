@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Checks of the parser core, run scpi-test
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-test
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += scpitest.cpp
+
+include(scpicore.pri)
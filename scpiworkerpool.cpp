@@ -0,0 +1,162 @@
+#include "scpiworkerpool.h"
+
+/* pool and worker index of the current thread */
+static thread_local SCPIWorkerPool * current_pool = NULL;
+static thread_local int current_worker = -1;
+
+SCPIWorkerPool::SCPIWorkerPool(int workers) :
+    drained(NULL),
+    user_context(NULL),
+    next(0),
+    pending(0),
+    sleeping(0),
+    stop(false)
+{
+    int i;
+
+    if (workers <= 0) {
+        workers = std::thread::hardware_concurrency();
+    }
+    if (workers <= 0) {
+        workers = 1;
+    }
+
+    count = workers;
+    this->workers = new worker_t[count];
+    for (i = 0; i < count; i++) {
+        this->workers[i].thread = std::thread(&SCPIWorkerPool::workerRun, this, i);
+    }
+}
+
+SCPIWorkerPool::~SCPIWorkerPool()
+{
+    int i;
+
+    {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        stop.store(true);
+    }
+    idle.notify_all();
+
+    for (i = 0; i < count; i++) {
+        workers[i].thread.join();
+    }
+    delete[] workers;
+}
+
+/**
+ * Schedule session with new units or completed operations, can be called
+ * from any thread. Session is queued only once until it runs.
+ * @param session
+ */
+void SCPIWorkerPool::schedule(SCPICore * session) {
+    SCPICore::scpi_units_t * units = session->scpi_units;
+
+    units->notified.store(true);
+    if (!units->scheduled.exchange(true, std::memory_order_acq_rel)) {
+        push(session);
+    }
+}
+
+/**
+ * Queue session to the current worker or to the next one round robin
+ * and wake up an idle worker
+ * @param session
+ */
+void SCPIWorkerPool::push(SCPICore * session) {
+    int index;
+
+    if (current_pool == this) {
+        index = current_worker;
+    } else {
+        index = next.fetch_add(1, std::memory_order_relaxed) % count;
+    }
+
+    /* counted first, so workers do not fall asleep while it is queued */
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> guard(workers[index].lock);
+        workers[index].queue.push_back(session);
+    }
+
+    if (sleeping.load() > 0) {
+        std::lock_guard<std::mutex> guard(idle_lock);
+        idle.notify_one();
+    }
+}
+
+/**
+ * Take session from own queue (newest first), steal from other workers
+ * (oldest first) if it is empty
+ * @param index - worker index
+ * @return session or NULL
+ */
+SCPICore * SCPIWorkerPool::take(int index) {
+    SCPICore * session = NULL;
+    int i;
+
+    {
+        std::lock_guard<std::mutex> guard(workers[index].lock);
+        if (!workers[index].queue.empty()) {
+            session = workers[index].queue.back();
+            workers[index].queue.pop_back();
+        }
+    }
+
+    for (i = 1; session == NULL && i < count; i++) {
+        worker_t * victim = &workers[(index + i) % count];
+        std::lock_guard<std::mutex> guard(victim->lock);
+        if (!victim->queue.empty()) {
+            session = victim->queue.front();
+            victim->queue.pop_front();
+        }
+    }
+
+    if (session != NULL) {
+        pending.fetch_sub(1);
+    }
+    return session;
+}
+
+/**
+ * Run units of the session. If the session used its budget it is queued
+ * again, otherwise it is released and queued again only if it was
+ * notified meanwhile.
+ * @param session
+ */
+void SCPIWorkerPool::run(SCPICore * session) {
+    SCPICore::scpi_units_t * units = session->scpi_units;
+
+    units->notified.store(false);
+    if (session->SCPI_UnitsRun(SCPI_POOL_BUDGET) == SCPI_POOL_BUDGET) {
+        push(session);
+        return;
+    }
+
+    units->scheduled.store(false);
+    if (units->notified.load() && !units->scheduled.exchange(true)) {
+        push(session);
+    }
+}
+
+void SCPIWorkerPool::workerRun(int index) {
+    SCPICore * session;
+
+    current_pool = this;
+    current_worker = index;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        session = take(index);
+        if (session != NULL) {
+            run(session);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(idle_lock);
+        sleeping.fetch_add(1);
+        while (!stop.load() && pending.load() == 0) {
+            idle.wait(guard);
+        }
+        sleeping.fetch_sub(1);
+    }
+}
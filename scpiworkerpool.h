@@ -0,0 +1,69 @@
+/**
+ * @file   scpiworkerpool.h
+ *
+ * @brief  Work stealing pool executing command units of many sessions
+ *
+ * Transport threads only resolve commands with SCPI_InputDispatch. Each
+ * session is a strand: its units are executed in order by at most one
+ * worker at a time, different sessions run in parallel. Every worker has
+ * own queue of sessions, idle workers steal from the others.
+ */
+
+#ifndef SCPIWORKERPOOL_H
+#define SCPIWORKERPOOL_H
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+#include "scpicore.h"
+
+/* number of units executed before the session yields to other sessions */
+#ifndef SCPI_POOL_BUDGET
+#define SCPI_POOL_BUDGET 16
+#endif
+
+class SCPIWorkerPool
+{
+public:
+    /**
+     * Start worker threads
+     * @param workers - number of workers, 0 for number of cores
+     */
+    explicit SCPIWorkerPool(int workers = 0);
+    ~SCPIWorkerPool();
+
+    void schedule(SCPICore * session);
+
+    /* called on a worker when a stalled session has free units again,
+     * the transport should call SCPI_InputDispatch(NULL, 0) on its thread */
+    void (*drained)(SCPICore * session, void * user_context);
+    void * user_context;
+
+private:
+    struct worker_t {
+        std::mutex lock;
+        std::deque<SCPICore *> queue;
+        std::thread thread;
+    };
+
+    worker_t * workers;
+    int count;
+    std::atomic<unsigned> next;
+    std::atomic<size_t> pending;
+    std::atomic<int> sleeping;
+    std::atomic<bool> stop;
+    std::mutex idle_lock;
+    std::condition_variable idle;
+
+    void workerRun(int index);
+    SCPICore * take(int index);
+    void push(SCPICore * session);
+    void run(SCPICore * session);
+
+    friend class SCPICore;
+};
+
+#endif // SCPIWORKERPOOL_H
@@ -0,0 +1,396 @@
+/**
+ * @file   server_epoll.cpp
+ *
+ * @brief  Raw socket SCPI server driven by epoll
+ *
+ * One parser session per connection, all sessions share one instrument
+ * definition. Sockets are non-blocking and edge triggered, data are
+ * received directly to the input buffer of the session and responses are
+ * sent from its output queue, all complete responses by one send.
+ *
+ * Connections are served by reactor threads pinned to cores. Every reactor
+ * has its own epoll instance and own listener on the same port
+ * (SO_REUSEPORT), the kernel spreads incoming connections between them.
+ * Reactors share nothing except the instrument definition, a connection
+ * with its session lives in one reactor until it is closed.
+ *
+ * Usage: scpi-server-epoll [-t reactors] [port]
+ *   -t  number of reactor threads, default is number of usable cores
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+#include "scpicore.h"
+
+#define SERVER_PORT 5025
+#define SERVER_EVENTS 256
+#define SERVER_REACTORS 256
+
+/* ms before paused listener tries to accept again, descriptors can be freed
+ * by other reactors too */
+#define SERVER_ACCEPT_RETRY 100
+
+/* connection state
+ * rx_full - input buffer was full, socket can hold unread data
+ * tx_full - socket buffer was full, response waits for EPOLLOUT */
+struct connection_t {
+    int fd;
+    SCPICore * session;
+    bool rx_full;
+    bool tx_full;
+};
+
+static const SCPICore::scpi_command_t server_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t server_instrument;
+
+/**
+ * Send responses from output queue until it is empty or socket is full.
+ * Reading the queue lets the session continue with waiting commands.
+ * @param conn
+ * @return false if the connection failed
+ */
+static bool connectionWrite(connection_t * conn) {
+    const char * data;
+    size_t len;
+    ssize_t sent;
+
+    for (;;) {
+        len = conn->session->SCPI_OutputPeek(&data);
+        if (len == 0) {
+            conn->tx_full = false;
+            return true;
+        }
+
+        sent = send(conn->fd, data, len, MSG_NOSIGNAL);
+        if (sent > 0) {
+            conn->session->SCPI_OutputConsume(sent);
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn->tx_full = true;
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Receive data directly to input buffer of the session and send responses
+ * of every received batch. Reading stops if the input buffer is full,
+ * session is blocked until its responses are sent.
+ * @param conn
+ * @return false if the connection was closed or failed
+ */
+static bool connectionRead(connection_t * conn) {
+    char * buffer;
+    size_t room;
+    ssize_t received;
+
+    for (;;) {
+        buffer = conn->session->SCPI_InputBuffer(&room);
+        if (room == 0) {
+            conn->rx_full = true;
+            return true;
+        }
+
+        received = recv(conn->fd, buffer, room, 0);
+        if (received > 0) {
+            conn->session->SCPI_InputCommit(received);
+            if (!connectionWrite(conn)) {
+                return false;
+            }
+        } else if (received == 0) {
+            return false;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            conn->rx_full = false;
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+static void connectionClose(connection_t * conn) {
+    close(conn->fd);
+    delete conn->session;
+    delete conn;
+}
+
+/**
+ * Accept all pending connections
+ * @param epfd - epoll instance
+ * @param listener - listening socket
+ * @return false if the process is out of descriptors, pending connections
+ * stay in the listen queue
+ */
+static bool serverAccept(int epfd, int listener) {
+    struct epoll_event event;
+    connection_t * conn;
+    int fd;
+    int one = 1;
+
+    for (;;) {
+        fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return errno != EMFILE && errno != ENFILE && errno != ENOBUFS && errno != ENOMEM;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        conn = new connection_t;
+        conn->fd = fd;
+        conn->session = new SCPISession(&server_instrument);
+        conn->session->SCPI_Init();
+        conn->rx_full = false;
+        conn->tx_full = false;
+
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            connectionClose(conn);
+        }
+    }
+}
+
+/**
+ * Stop or resume watching the listener. Listener is level triggered, it
+ * has to be paused while connections can not be accepted.
+ * @param epfd - epoll instance
+ * @param listener - listening socket
+ * @param enable
+ */
+static void serverListenerWatch(int epfd, int listener, bool enable) {
+    struct epoll_event event;
+
+    event.events = enable ? (uint32_t) EPOLLIN : 0;
+    event.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, listener, &event);
+}
+
+/**
+ * Create listening socket
+ * @param port - TCP port
+ * @return socket or -1
+ */
+static int serverListen(int port) {
+    struct sockaddr_in addr;
+    int fd;
+    int one = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Raise limit of open descriptors to the hard limit, each connection
+ * needs one
+ */
+static void serverRaiseLimit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/**
+ * Pin calling thread to n-th usable core
+ * @param n - reactor index
+ */
+static void reactorPin(int n) {
+    cpu_set_t allowed;
+    cpu_set_t cpu;
+    int count;
+    int i;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) {
+        return;
+    }
+    count = CPU_COUNT(&allowed);
+    if (count <= 0) {
+        return;
+    }
+    n %= count;
+
+    for (i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &allowed) && n-- == 0) {
+            CPU_ZERO(&cpu);
+            CPU_SET(i, &cpu);
+            pthread_setaffinity_np(pthread_self(), sizeof(cpu), &cpu);
+            return;
+        }
+    }
+}
+
+/**
+ * Event loop of one reactor, serves connections accepted by its listener
+ * @param index - reactor index
+ * @param listener - listening socket of the reactor
+ */
+static void reactorRun(int index, int listener) {
+    struct epoll_event events[SERVER_EVENTS];
+    struct epoll_event event;
+    bool paused = false;
+    bool closed;
+    int epfd;
+    int count;
+    int i;
+
+    reactorPin(index);
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        exit(1);
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &event);
+
+    for (;;) {
+        count = epoll_wait(epfd, events, SERVER_EVENTS, paused ? SERVER_ACCEPT_RETRY : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            exit(1);
+        }
+
+        closed = false;
+        for (i = 0; i < count; i++) {
+            connection_t * conn = (connection_t *) events[i].data.ptr;
+            bool alive = true;
+
+            if (conn == NULL) {
+                if (!serverAccept(epfd, listener)) {
+                    serverListenerWatch(epfd, listener, false);
+                    paused = true;
+                }
+                continue;
+            }
+
+            if (events[i].events & EPOLLERR) {
+                alive = false;
+            }
+            if (alive && (events[i].events & EPOLLOUT) && conn->tx_full) {
+                alive = connectionWrite(conn);
+            }
+            /* sent responses could free the input buffer */
+            if (alive && ((events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) || conn->rx_full)) {
+                alive = connectionRead(conn);
+            }
+            if (!alive) {
+                connectionClose(conn);
+                closed = true;
+            }
+        }
+
+        /* out of descriptors, try again when one is freed or on timeout */
+        if (paused && (closed || count == 0)) {
+            paused = !serverAccept(epfd, listener);
+            if (!paused) {
+                serverListenerWatch(epfd, listener, true);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::thread threads[SERVER_REACTORS];
+    int listeners[SERVER_REACTORS];
+    cpu_set_t allowed;
+    int port = SERVER_PORT;
+    int reactors = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            reactors = atoi(argv[++i]);
+        } else {
+            port = atoi(argv[i]);
+        }
+    }
+    if (reactors <= 0 && sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        reactors = CPU_COUNT(&allowed);
+    }
+    if (reactors <= 0) {
+        reactors = 1;
+    }
+    if (reactors > SERVER_REACTORS) {
+        reactors = SERVER_REACTORS;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    serverRaiseLimit();
+    SCPICore::SCPI_InstrumentInit(&server_instrument, server_commands);
+
+    /* all listeners are bound before any reactor accepts */
+    for (i = 0; i < reactors; i++) {
+        listeners[i] = serverListen(port);
+        if (listeners[i] < 0) {
+            perror("listen");
+            return 1;
+        }
+    }
+
+    for (i = 1; i < reactors; i++) {
+        threads[i] = std::thread(reactorRun, i, listeners[i]);
+    }
+    reactorRun(0, listeners[0]);
+
+    return 0;
+}
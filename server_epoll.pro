@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Raw socket SCPI server (port 5025), Linux epoll
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-server-epoll
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += server_epoll.cpp
+
+include(scpicore.pri)
@@ -0,0 +1,930 @@
+/**
+ * @file   server_hislip.cpp
+ *
+ * @brief  HiSLIP (IVI-6.1) SCPI server driven by epoll
+ *
+ * Client opens synchronous channel (Initialize) and asynchronous channel
+ * (AsyncInitialize) for one session. Data and DataEND messages of the
+ * synchronous channel are received directly to the input buffer of the
+ * session, DataEND ends the program message, so the last command line does
+ * not need terminator. Messages are processed one by one, all responses
+ * of a message are sent with its MessageID, the last one as DataEND.
+ *
+ * Asynchronous channel serves device clear, status query, SRQ, lock and
+ * remote/local requests.
+ *
+ * In synchronized mode new message interrupts response which was not framed
+ * for send yet (Interrupted, AsyncInterrupted, -410), already framed parts
+ * are discarded by the client by MessageID. In overlap mode pipelined
+ * messages wait for responses of previous ones, so they are answered in
+ * order.
+ *
+ * Usage: scpi-server-hislip [-o] [port]
+ *   -o  prefer overlap mode
+ */
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scpicore.h"
+
+#define HISLIP_PORT 4880
+#define HISLIP_EVENTS 256
+#define HISLIP_HEADER_LENGTH 16
+#define HISLIP_PROTOCOL_VERSION 0x0100
+#define HISLIP_VENDOR_ID (('S' << 8) | 'P')
+#define HISLIP_MAX_MESSAGE_SIZE 0xffffffffull
+#define HISLIP_CONTROL_PAYLOAD 256
+#define HISLIP_TX_LENGTH (SCPI_OUTPUT_QUEUE_LENGTH + 4 * HISLIP_HEADER_LENGTH)
+#define HISLIP_SESSIONS 65536
+
+/* message types */
+#define HISLIP_INITIALIZE 0
+#define HISLIP_INITIALIZE_RESPONSE 1
+#define HISLIP_FATAL_ERROR 2
+#define HISLIP_ERROR 3
+#define HISLIP_ASYNC_LOCK 4
+#define HISLIP_ASYNC_LOCK_RESPONSE 5
+#define HISLIP_DATA 6
+#define HISLIP_DATA_END 7
+#define HISLIP_DEVICE_CLEAR_COMPLETE 8
+#define HISLIP_DEVICE_CLEAR_ACKNOWLEDGE 9
+#define HISLIP_ASYNC_REMOTE_LOCAL_CONTROL 10
+#define HISLIP_ASYNC_REMOTE_LOCAL_RESPONSE 11
+#define HISLIP_TRIGGER 12
+#define HISLIP_INTERRUPTED 13
+#define HISLIP_ASYNC_INTERRUPTED 14
+#define HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE 15
+#define HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE 16
+#define HISLIP_ASYNC_INITIALIZE 17
+#define HISLIP_ASYNC_INITIALIZE_RESPONSE 18
+#define HISLIP_ASYNC_DEVICE_CLEAR 19
+#define HISLIP_ASYNC_SERVICE_REQUEST 20
+#define HISLIP_ASYNC_STATUS_QUERY 21
+#define HISLIP_ASYNC_STATUS_RESPONSE 22
+#define HISLIP_ASYNC_DEVICE_CLEAR_ACKNOWLEDGE 23
+#define HISLIP_ASYNC_LOCK_INFO 24
+#define HISLIP_ASYNC_LOCK_INFO_RESPONSE 25
+#define HISLIP_VENDOR_SPECIFIC 128
+
+/* FatalError control codes */
+#define HISLIP_FATAL_POORLY_FORMED_HEADER 1
+#define HISLIP_FATAL_CHANNELS_NOT_ESTABLISHED 2
+#define HISLIP_FATAL_INVALID_INITIALIZATION 3
+#define HISLIP_FATAL_MAXIMUM_CLIENTS 4
+
+/* Error control codes */
+#define HISLIP_ERROR_MESSAGE_TYPE 1
+#define HISLIP_ERROR_VENDOR_SPECIFIC 3
+
+enum channel_kind_t {
+    CHANNEL_NEW,
+    CHANNEL_SYNC,
+    CHANNEL_ASYNC,
+};
+
+struct session_t;
+
+/* one TCP connection
+ * header, header_len - header being received
+ * payload_left - payload of current message still to receive
+ * control - payload of other than data message, truncated
+ * tx, tx_len, tx_sent - framed messages waiting for send
+ * started - data message passed the session, its payload can be received
+ * rx_paused - data message waits until the session is ready
+ * dead - closed, freed after current batch of events */
+struct channel_t {
+    int fd;
+    channel_kind_t kind;
+    session_t * session;
+    uint8_t header[HISLIP_HEADER_LENGTH];
+    size_t header_len;
+    uint8_t type;
+    uint8_t control_code;
+    uint32_t parameter;
+    uint64_t payload_left;
+    char control[HISLIP_CONTROL_PAYLOAD];
+    size_t control_len;
+    char tx[HISLIP_TX_LENGTH];
+    size_t tx_len;
+    size_t tx_sent;
+    bool started;
+    bool rx_paused;
+    bool dead;
+    channel_t * next_dead;
+};
+
+/* session of synchronous and asynchronous channel
+ * message_id - MessageID of the message being processed
+ * clearing - device clear started, waits for DeviceClearComplete */
+struct session_t {
+    uint16_t id;
+    SCPICore * parser;
+    channel_t * sync;
+    channel_t * async;
+    bool overlap;
+    bool clearing;
+    uint32_t message_id;
+    uint64_t client_max;
+};
+
+static const SCPICore::scpi_command_t server_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t server_instrument;
+static session_t * sessions[HISLIP_SESSIONS];
+static uint16_t session_next = 1;
+static bool overlap_preferred = false;
+static channel_t * dead_channels = NULL;
+
+static void put16(uint8_t * p, uint16_t val) {
+    p[0] = val >> 8;
+    p[1] = val;
+}
+
+static void put32(uint8_t * p, uint32_t val) {
+    put16(p, val >> 16);
+    put16(p + 2, val);
+}
+
+static void put64(uint8_t * p, uint64_t val) {
+    put32(p, val >> 32);
+    put32(p + 4, val);
+}
+
+static uint32_t get32(const uint8_t * p) {
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+static uint64_t get64(const uint8_t * p) {
+    return ((uint64_t) get32(p) << 32) | get32(p + 4);
+}
+
+/**
+ * Send queued messages until all are sent or socket is full
+ * @param ch
+ * @return false if the connection failed
+ */
+static bool channelSend(channel_t * ch) {
+    ssize_t sent;
+
+    while (ch->tx_sent < ch->tx_len) {
+        sent = send(ch->fd, ch->tx + ch->tx_sent, ch->tx_len - ch->tx_sent, MSG_NOSIGNAL);
+        if (sent > 0) {
+            ch->tx_sent += sent;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        } else if (errno != EINTR) {
+            return false;
+        }
+    }
+    ch->tx_len = 0;
+    ch->tx_sent = 0;
+    return true;
+}
+
+/**
+ * Get free space for messages waiting for send
+ * @param ch
+ * @return number of bytes
+ */
+static size_t channelRoom(channel_t * ch) {
+    if (ch->tx_sent == ch->tx_len) {
+        ch->tx_len = 0;
+        ch->tx_sent = 0;
+    }
+    return HISLIP_TX_LENGTH - ch->tx_len;
+}
+
+/**
+ * Queue message, messages without room are dropped (control messages are
+ * short and the client reads them)
+ * @param ch
+ * @param type - message type
+ * @param control_code
+ * @param parameter - message parameter
+ * @param payload - payload or NULL
+ * @param len - payload length
+ */
+static void channelQueue(channel_t * ch, uint8_t type, uint8_t control_code, uint32_t parameter, const char * payload, size_t len) {
+    uint8_t * header;
+
+    if (ch == NULL || channelRoom(ch) < HISLIP_HEADER_LENGTH + len) {
+        return;
+    }
+
+    header = (uint8_t *) ch->tx + ch->tx_len;
+    header[0] = 'H';
+    header[1] = 'S';
+    header[2] = type;
+    header[3] = control_code;
+    put32(header + 4, parameter);
+    put64(header + 8, len);
+    if (len > 0) {
+        memcpy(ch->tx + ch->tx_len + HISLIP_HEADER_LENGTH, payload, len);
+    }
+    ch->tx_len += HISLIP_HEADER_LENGTH + len;
+}
+
+/**
+ * Close channel, both channels of its session and the session
+ * @param ch
+ */
+static void channelClose(channel_t * ch) {
+    session_t * s = ch->session;
+
+    if (ch->dead) {
+        return;
+    }
+    ch->dead = true;
+    close(ch->fd);
+    ch->next_dead = dead_channels;
+    dead_channels = ch;
+
+    if (s == NULL) {
+        return;
+    }
+    ch->session = NULL;
+    if (s->sync == ch) {
+        s->sync = NULL;
+    }
+    if (s->async == ch) {
+        s->async = NULL;
+    }
+    if (s->sync != NULL) {
+        channelClose(s->sync);
+    }
+    if (s->async != NULL) {
+        channelClose(s->async);
+    }
+    sessions[s->id] = NULL;
+    delete s->parser;
+    delete s;
+}
+
+/**
+ * Report fatal error and close the connection
+ * @param ch
+ * @param code - FatalError control code
+ */
+static void channelFatal(channel_t * ch, uint8_t code) {
+    channelQueue(ch, HISLIP_FATAL_ERROR, code, 0, NULL, 0);
+    channelSend(ch);
+    channelClose(ch);
+}
+
+/**
+ * Session can start next message: previous one is processed and its
+ * responses are queued for send
+ * @param s
+ * @return
+ */
+static bool sessionReady(session_t * s) {
+    return s->parser->SCPI_InputIdle() && (s->parser->SCPI_OutputCount() == 0);
+}
+
+/**
+ * Move responses from output queue to the synchronous channel. Last part
+ * of complete responses is sent as DataEND.
+ * @param s
+ */
+static void sessionFlush(session_t * s) {
+    channel_t * ch = s->sync;
+    const char * data;
+    size_t len;
+    size_t room;
+    uint8_t type;
+
+    for (;;) {
+        len = s->parser->SCPI_OutputPeek(&data);
+        /* room of one header is left for Interrupted and other replies */
+        room = channelRoom(ch);
+        if (len == 0 || room <= 2 * HISLIP_HEADER_LENGTH) {
+            break;
+        }
+        room -= 2 * HISLIP_HEADER_LENGTH;
+        if (room > s->client_max) {
+            room = s->client_max;
+        }
+
+        type = HISLIP_DATA;
+        if (len <= room) {
+            if (s->parser->SCPI_ResponseComplete()) {
+                type = HISLIP_DATA_END;
+            }
+        } else {
+            len = room;
+        }
+        channelQueue(ch, type, 0, s->message_id, data, len);
+        /* can process next command line of the message */
+        s->parser->SCPI_OutputConsume(len);
+    }
+}
+
+/**
+ * New message in synchronized mode interrupts response which was not read
+ * yet. Rest of the previous message is executed, its responses are
+ * discarded.
+ * @param s
+ * @param message_id - MessageID of the new message
+ */
+static void sessionInterrupt(session_t * s, uint32_t message_id) {
+    size_t count;
+
+    if (s->overlap || s->parser->SCPI_OutputCount() == 0) {
+        return;
+    }
+
+    while ((count = s->parser->SCPI_OutputCount()) > 0) {
+        s->parser->SCPI_OutputConsume(count);
+    }
+    s->parser->SCPI_ErrorPush(SCPI_ERROR_QUERY_INTERRUPTED);
+    channelQueue(s->sync, HISLIP_INTERRUPTED, 0, message_id, NULL, 0);
+    channelQueue(s->async, HISLIP_ASYNC_INTERRUPTED, 0, message_id, NULL, 0);
+    channelSend(s->async);
+}
+
+/**
+ * Let data message in when the previous one is processed. It becomes the
+ * current message, its responses are sent with its MessageID.
+ * @param ch - synchronous channel
+ * @return false if the message has to wait
+ */
+static bool messageStart(channel_t * ch) {
+    session_t * s = ch->session;
+
+    if (ch->started) {
+        return true;
+    }
+    if (!s->clearing) {
+        sessionInterrupt(s, ch->parameter);
+        if (!sessionReady(s)) {
+            return false;
+        }
+        s->message_id = ch->parameter;
+    }
+    ch->started = true;
+    return true;
+}
+
+/**
+ * Deliver service request on the asynchronous channel
+ * @param user_context - session
+ * @param stb - status byte
+ * @param changed - changed bits
+ */
+static void sessionStatus(void * user_context, scpi_reg_val_t stb, scpi_reg_val_t changed) {
+    session_t * s = (session_t *) user_context;
+
+    (void) changed;
+    if ((stb & STB_SRQ) && s->async != NULL) {
+        channelQueue(s->async, HISLIP_ASYNC_SERVICE_REQUEST, stb, 0, NULL, 0);
+        channelSend(s->async);
+    }
+}
+
+static session_t * sessionNew(void) {
+    session_t * s;
+    int i;
+
+    for (i = 0; i < HISLIP_SESSIONS && (session_next == 0 || sessions[session_next] != NULL); i++) {
+        session_next++;
+    }
+    if (i == HISLIP_SESSIONS) {
+        return NULL;
+    }
+
+    s = new session_t;
+    s->id = session_next++;
+    s->parser = new SCPISession(&server_instrument);
+    s->parser->SCPI_Init();
+    s->parser->SCPI_StatusSubscribe(sessionStatus, s, STB_SRQ);
+    s->sync = NULL;
+    s->async = NULL;
+    s->overlap = overlap_preferred;
+    s->clearing = false;
+    s->message_id = 0xffffff00;
+    s->client_max = HISLIP_MAX_MESSAGE_SIZE;
+    sessions[s->id] = s;
+    return s;
+}
+
+/**
+ * Handle header of received message. Messages are accepted only after
+ * initialization of both channels.
+ * @param ch
+ * @return false if the channel was closed
+ */
+static bool messageBegin(channel_t * ch) {
+    session_t * s = ch->session;
+
+    if (ch->header[0] != 'H' || ch->header[1] != 'S') {
+        channelFatal(ch, HISLIP_FATAL_POORLY_FORMED_HEADER);
+        return false;
+    }
+    ch->type = ch->header[2];
+    ch->control_code = ch->header[3];
+    ch->parameter = get32(ch->header + 4);
+    ch->payload_left = get64(ch->header + 8);
+    ch->control_len = 0;
+    ch->started = false;
+
+    if (ch->kind == CHANNEL_NEW) {
+        if (ch->type != HISLIP_INITIALIZE && ch->type != HISLIP_ASYNC_INITIALIZE) {
+            channelFatal(ch, HISLIP_FATAL_INVALID_INITIALIZATION);
+            return false;
+        }
+        return true;
+    }
+
+    if (ch->type == HISLIP_DATA || ch->type == HISLIP_DATA_END) {
+        if (s->async == NULL) {
+            channelFatal(ch, HISLIP_FATAL_CHANNELS_NOT_ESTABLISHED);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Handle message of the synchronous channel
+ * @param ch
+ * @return false if the channel was closed
+ */
+static bool messageSync(channel_t * ch) {
+    session_t * s = ch->session;
+
+    switch (ch->type) {
+        case HISLIP_DATA:
+            break;
+
+        case HISLIP_DATA_END:
+            if (!s->clearing) {
+                s->parser->SCPI_InputEnd();
+            }
+            break;
+
+        case HISLIP_DEVICE_CLEAR_COMPLETE:
+            /* data received during device clear are discarded */
+            s->parser->SCPI_DeviceClear();
+            s->clearing = false;
+            s->overlap = (ch->control_code & 1) ? true : false;
+            s->message_id = 0xffffff00;
+            channelQueue(ch, HISLIP_DEVICE_CLEAR_ACKNOWLEDGE, s->overlap ? 1 : 0, 0, NULL, 0);
+            break;
+
+        case HISLIP_TRIGGER:
+            /* no trigger subsystem */
+            break;
+
+        default:
+            channelQueue(ch, HISLIP_ERROR, (ch->type >= HISLIP_VENDOR_SPECIFIC) ? HISLIP_ERROR_VENDOR_SPECIFIC : HISLIP_ERROR_MESSAGE_TYPE, 0, NULL, 0);
+            break;
+    }
+    return true;
+}
+
+/**
+ * Handle message of the asynchronous channel
+ * @param ch
+ * @return false if the channel was closed
+ */
+static bool messageAsync(channel_t * ch) {
+    session_t * s = ch->session;
+    scpi_reg_val_t stb;
+    uint8_t size[8];
+
+    switch (ch->type) {
+        case HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE:
+            if (ch->control_len >= 8) {
+                s->client_max = get64((uint8_t *) ch->control);
+                if (s->client_max < 1) {
+                    s->client_max = 1;
+                }
+            }
+            put64(size, HISLIP_MAX_MESSAGE_SIZE);
+            channelQueue(ch, HISLIP_ASYNC_MAXIMUM_MESSAGE_SIZE_RESPONSE, 0, 0, (char *) size, sizeof(size));
+            break;
+
+        case HISLIP_ASYNC_DEVICE_CLEAR:
+            s->clearing = true;
+            s->parser->SCPI_DeviceClear();
+            if (s->sync->tx_sent == 0) {
+                s->sync->tx_len = 0;
+            }
+            channelQueue(ch, HISLIP_ASYNC_DEVICE_CLEAR_ACKNOWLEDGE, overlap_preferred ? 1 : 0, 0, NULL, 0);
+            break;
+
+        case HISLIP_ASYNC_STATUS_QUERY:
+            stb = s->parser->SCPI_RegGet(SCPI_REG_STB);
+            /* responses waiting for send are still available */
+            if (s->sync->tx_len > s->sync->tx_sent) {
+                stb |= STB_MAV;
+            }
+            channelQueue(ch, HISLIP_ASYNC_STATUS_RESPONSE, stb, 0, NULL, 0);
+            break;
+
+        case HISLIP_ASYNC_LOCK:
+            /* locking is not supported, every request succeeds */
+            channelQueue(ch, HISLIP_ASYNC_LOCK_RESPONSE, 1, 0, NULL, 0);
+            break;
+
+        case HISLIP_ASYNC_LOCK_INFO:
+            channelQueue(ch, HISLIP_ASYNC_LOCK_INFO_RESPONSE, 0, 0, NULL, 0);
+            break;
+
+        case HISLIP_ASYNC_REMOTE_LOCAL_CONTROL:
+            channelQueue(ch, HISLIP_ASYNC_REMOTE_LOCAL_RESPONSE, 0, 0, NULL, 0);
+            break;
+
+        default:
+            channelQueue(ch, HISLIP_ERROR, (ch->type >= HISLIP_VENDOR_SPECIFIC) ? HISLIP_ERROR_VENDOR_SPECIFIC : HISLIP_ERROR_MESSAGE_TYPE, 0, NULL, 0);
+            break;
+    }
+    return true;
+}
+
+/**
+ * Handle the first message of new channel
+ * @param ch
+ * @return false if the channel was closed
+ */
+static bool messageInitialize(channel_t * ch) {
+    session_t * s;
+
+    if (ch->type == HISLIP_INITIALIZE) {
+        s = sessionNew();
+        if (s == NULL) {
+            channelFatal(ch, HISLIP_FATAL_MAXIMUM_CLIENTS);
+            return false;
+        }
+        ch->kind = CHANNEL_SYNC;
+        ch->session = s;
+        s->sync = ch;
+        channelQueue(ch, HISLIP_INITIALIZE_RESPONSE, s->overlap ? 1 : 0, ((uint32_t) HISLIP_PROTOCOL_VERSION << 16) | s->id, NULL, 0);
+        return true;
+    }
+
+    s = sessions[ch->parameter & 0xffff];
+    if (s == NULL || s->async != NULL) {
+        channelFatal(ch, HISLIP_FATAL_INVALID_INITIALIZATION);
+        return false;
+    }
+    ch->kind = CHANNEL_ASYNC;
+    ch->session = s;
+    s->async = ch;
+    channelQueue(ch, HISLIP_ASYNC_INITIALIZE_RESPONSE, 0, HISLIP_VENDOR_ID, NULL, 0);
+    return true;
+}
+
+/**
+ * Handle completely received message
+ * @param ch
+ * @return false if the channel was closed
+ */
+static bool messageEnd(channel_t * ch) {
+    ch->header_len = 0;
+
+    switch (ch->kind) {
+        case CHANNEL_NEW:
+            return messageInitialize(ch);
+        case CHANNEL_SYNC:
+            return messageSync(ch);
+        case CHANNEL_ASYNC:
+            return messageAsync(ch);
+    }
+    return true;
+}
+
+/**
+ * Receive messages. Payload of Data and DataEND goes directly to the input
+ * buffer of the session, data message waits until the session is ready.
+ * @param ch
+ * @return false if the connection was closed or failed
+ */
+static bool channelRead(channel_t * ch) {
+    session_t * s;
+    char discard[HISLIP_CONTROL_PAYLOAD];
+    char * buffer;
+    size_t room;
+    ssize_t received;
+    bool data;
+
+    for (;;) {
+        s = ch->session;
+        if (ch->header_len < HISLIP_HEADER_LENGTH) {
+            buffer = (char *) ch->header + ch->header_len;
+            room = HISLIP_HEADER_LENGTH - ch->header_len;
+        } else {
+            data = (ch->kind == CHANNEL_SYNC) && (ch->type == HISLIP_DATA || ch->type == HISLIP_DATA_END);
+            if (data && !messageStart(ch)) {
+                ch->rx_paused = true;
+                return true;
+            }
+            if (data && !s->clearing) {
+                buffer = s->parser->SCPI_InputBuffer(&room);
+                if (room == 0) {
+                    ch->rx_paused = true;
+                    return true;
+                }
+            } else if (ch->control_len < HISLIP_CONTROL_PAYLOAD && !data) {
+                buffer = ch->control + ch->control_len;
+                room = HISLIP_CONTROL_PAYLOAD - ch->control_len;
+            } else {
+                buffer = discard;
+                room = sizeof(discard);
+            }
+            if (room > ch->payload_left) {
+                room = ch->payload_left;
+            }
+        }
+
+        received = 0;
+        if (room > 0) {
+            received = recv(ch->fd, buffer, room, 0);
+            if (received == 0) {
+                return false;
+            } else if (received < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    ch->rx_paused = false;
+                    return true;
+                } else if (errno != EINTR) {
+                    return false;
+                }
+                continue;
+            }
+        }
+
+        if (ch->header_len < HISLIP_HEADER_LENGTH) {
+            ch->header_len += received;
+            if (ch->header_len < HISLIP_HEADER_LENGTH) {
+                continue;
+            }
+            if (!messageBegin(ch)) {
+                return true;
+            }
+            /* data message without payload has to pass the session too */
+            continue;
+        } else {
+            ch->payload_left -= received;
+            if (buffer == ch->control + ch->control_len) {
+                ch->control_len += received;
+            } else if (buffer != discard && received > 0) {
+                s->parser->SCPI_InputCommit(received);
+                sessionFlush(s);
+            }
+        }
+
+        if (ch->payload_left == 0) {
+            if (!messageEnd(ch)) {
+                return true;
+            }
+            s = ch->session;
+            if (s != NULL && s->sync != NULL) {
+                sessionFlush(s);
+            }
+        }
+    }
+}
+
+/**
+ * Accept all pending connections
+ * @param epfd - epoll instance
+ * @param listener - listening socket
+ */
+static void serverAccept(int epfd, int listener) {
+    struct epoll_event event;
+    channel_t * ch;
+    int fd;
+    int one = 1;
+
+    for (;;) {
+        fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        ch = new channel_t;
+        ch->fd = fd;
+        ch->kind = CHANNEL_NEW;
+        ch->session = NULL;
+        ch->header_len = 0;
+        ch->payload_left = 0;
+        ch->control_len = 0;
+        ch->tx_len = 0;
+        ch->tx_sent = 0;
+        ch->started = false;
+        ch->rx_paused = false;
+        ch->dead = false;
+        ch->next_dead = NULL;
+
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = ch;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            close(fd);
+            delete ch;
+        }
+    }
+}
+
+/**
+ * Send framed messages of synchronous channel and frame next responses
+ * while the socket takes them. Sent responses can let waiting message in.
+ * @param s
+ * @return false if the connection failed
+ */
+static bool sessionProgress(session_t * s) {
+    channel_t * ch = s->sync;
+
+    for (;;) {
+        if (!channelSend(ch)) {
+            return false;
+        }
+        if (ch->tx_len != 0) {
+            /* socket is full, continues on EPOLLOUT */
+            return true;
+        }
+        sessionFlush(s);
+        if (ch->rx_paused && !channelRead(ch)) {
+            return false;
+        }
+        if (ch->dead || ch->tx_len == 0) {
+            return true;
+        }
+    }
+}
+
+/**
+ * Handle events of one channel
+ * @param ch
+ * @param events - epoll events
+ */
+static void channelEvent(channel_t * ch, uint32_t events) {
+    session_t * s;
+    bool alive = true;
+
+    if (events & EPOLLERR) {
+        alive = false;
+    }
+    if (alive && (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))) {
+        alive = channelRead(ch);
+    }
+    if (ch->dead) {
+        return;
+    }
+
+    s = ch->session;
+    if (alive && s != NULL && s->sync != NULL) {
+        alive = sessionProgress(s);
+    }
+    if (ch->dead) {
+        return;
+    }
+    if (alive && s != NULL && s->async != NULL) {
+        alive = channelSend(s->async);
+    }
+    if (alive && s == NULL) {
+        alive = channelSend(ch);
+    }
+    if (!alive) {
+        channelClose(ch);
+    }
+}
+
+/**
+ * Create listening socket
+ * @param port - TCP port
+ * @return socket or -1
+ */
+static int serverListen(int port) {
+    struct sockaddr_in addr;
+    int fd;
+    int one = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Raise limit of open descriptors to the hard limit, each session needs
+ * two
+ */
+static void serverRaiseLimit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct epoll_event events[HISLIP_EVENTS];
+    struct epoll_event event;
+    int port = HISLIP_PORT;
+    int listener;
+    int epfd;
+    int count;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0) {
+            overlap_preferred = true;
+        } else {
+            port = atoi(argv[i]);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    serverRaiseLimit();
+    SCPICore::SCPI_InstrumentInit(&server_instrument, server_commands);
+
+    listener = serverListen(port);
+    if (listener < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) {
+        perror("epoll_create1");
+        return 1;
+    }
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listener, &event);
+
+    for (;;) {
+        count = epoll_wait(epfd, events, HISLIP_EVENTS, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return 1;
+        }
+
+        for (i = 0; i < count; i++) {
+            channel_t * ch = (channel_t *) events[i].data.ptr;
+
+            if (ch == NULL) {
+                serverAccept(epfd, listener);
+            } else if (!ch->dead) {
+                channelEvent(ch, events[i].events);
+            }
+        }
+
+        /* events of this batch could refer to closed channels */
+        while (dead_channels != NULL) {
+            channel_t * ch = dead_channels;
+            dead_channels = ch->next_dead;
+            delete ch;
+        }
+    }
+
+    return 0;
+}
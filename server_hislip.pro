@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# HiSLIP SCPI server (port 4880), Linux epoll
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-server-hislip
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += server_hislip.cpp
+
+include(scpicore.pri)
@@ -0,0 +1,375 @@
+/**
+ * @file   server_serial.cpp
+ *
+ * @brief  SCPI service on RS-232 port (or pseudo-terminal) through termios
+ *
+ * The port is in raw mode and the read batching is left to the line
+ * discipline: VMIN/VTIME let one read return a whole burst of characters,
+ * not one character per wakeup. Data are read directly to the input buffer
+ * of the session, the terminator scan continues where the previous read
+ * stopped, so slow links arriving byte by byte are not rescanned.
+ *
+ * Terminator modes
+ *   lf   - program messages end by LF (CR accepted too), responses by LF
+ *   crlf - as lf, responses end by CR LF
+ *   eoi  - EOI emulation, program message ends by a pause longer than
+ *          VTIME after the last character, LF still terminates a line
+ *
+ * With -x the port uses XON/XOFF flow control in both directions. The
+ * output descriptor is non-blocking, when the peer holds the output by
+ * XOFF and the driver buffer fills, responses stay in the output queue of
+ * the session and the rest of the queue is written by one write after XON.
+ *
+ * Usage: scpi-server-serial [-b baud] [-t lf|crlf|eoi] [-m vmin] [-g vtime] [-x] device
+ *   -b  baud rate, default 9600
+ *   -t  terminator mode, default lf
+ *   -m  VMIN, minimal number of characters of one read
+ *   -g  VTIME, inter-character gap ending the read, tenths of a second
+ *   -x  XON/XOFF flow control
+ *
+ * Pseudo-terminal can be used for testing, the service opens its slave
+ * side (e.g. /dev/pts/3) and the test talks to the master side.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "scpicore.h"
+
+#define SERVER_BAUD 9600
+
+/* VMIN/VTIME of EOI emulation, read returns after 255 characters or after
+ * a pause of 0.1 s */
+#define SERVER_EOI_VMIN 255
+#define SERVER_EOI_VTIME 1
+
+enum port_mode_t {
+    PORT_LF,
+    PORT_CRLF,
+    PORT_EOI,
+};
+
+/* port state
+ * rd - blocking descriptor, reads are batched by VMIN/VTIME
+ * wr - non-blocking descriptor of the same port
+ * rx_full - input buffer was full, session waits until responses are read
+ * tx_full - output is held (XOFF) or driver buffer is full
+ * end_pending - last read was not ended by a pause, the pause can follow */
+struct port_t {
+    int rd;
+    int wr;
+    SCPICore * session;
+    port_mode_t mode;
+    int vmin;
+    int vtime;
+    bool rx_full;
+    bool tx_full;
+    bool end_pending;
+};
+
+static const struct {
+    int baud;
+    speed_t speed;
+} port_speeds[] = {
+    {1200, B1200},
+    {2400, B2400},
+    {4800, B4800},
+    {9600, B9600},
+    {19200, B19200},
+    {38400, B38400},
+    {57600, B57600},
+    {115200, B115200},
+    {230400, B230400},
+    {0, B0},
+};
+
+static const SCPICore::scpi_command_t server_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t server_instrument;
+
+/**
+ * Write responses from output queue until it is empty or the output is
+ * held. All complete responses are written by one write.
+ * @param port
+ * @return false if the port failed
+ */
+static bool portWrite(port_t * port) {
+    const char * data;
+    size_t len;
+    ssize_t written;
+
+    for (;;) {
+        len = port->session->SCPI_OutputPeek(&data);
+        if (len == 0) {
+            port->tx_full = false;
+            return true;
+        }
+
+        written = write(port->wr, data, len);
+        if (written > 0) {
+            port->session->SCPI_OutputConsume(written);
+        } else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            port->tx_full = true;
+            return true;
+        } else if (written == 0 || errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+/**
+ * Read one batch directly to the input buffer of the session and write its
+ * responses. In EOI emulation a read shorter than VMIN was ended by a
+ * pause, which ends the program message.
+ * @param port
+ * @return false if the port was closed or failed
+ */
+static bool portRead(port_t * port) {
+    char * buffer;
+    size_t room;
+    ssize_t received;
+
+    buffer = port->session->SCPI_InputBuffer(&room);
+    if (room == 0) {
+        port->rx_full = true;
+        return true;
+    }
+    port->rx_full = false;
+
+    received = read(port->rd, buffer, room);
+    if (received < 0) {
+        return (errno == EINTR || errno == EAGAIN);
+    }
+    if (received == 0) {
+        return false;
+    }
+    port->session->SCPI_InputCommit(received);
+
+    if (port->mode == PORT_EOI) {
+        if ((size_t) received < room && received < port->vmin) {
+            port->session->SCPI_InputEnd();
+            port->end_pending = false;
+        } else {
+            port->end_pending = true;
+        }
+    }
+    return portWrite(port);
+}
+
+/**
+ * Configure the port: raw mode, 8N1, speed, read batching and flow control
+ * @param fd - port
+ * @param speed
+ * @param vmin
+ * @param vtime
+ * @param xonxoff
+ * @return 0 on success, -1 on error
+ */
+static int portSetup(int fd, speed_t speed, int vmin, int vtime, bool xonxoff) {
+    struct termios tio;
+
+    if (tcgetattr(fd, &tio) < 0) {
+        return -1;
+    }
+
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | PARENB);
+    if (xonxoff) {
+        tio.c_iflag |= IXON | IXOFF;
+    }
+    tio.c_cc[VMIN] = vmin;
+    tio.c_cc[VTIME] = vtime;
+    cfsetispeed(&tio, speed);
+    cfsetospeed(&tio, speed);
+
+    if (tcsetattr(fd, TCSANOW, &tio) < 0) {
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return 0;
+}
+
+/**
+ * Open the port twice, blocking for batched reads and non-blocking for
+ * writes held by flow control
+ * @param port
+ * @param device - device path
+ * @return 0 on success, -1 on error
+ */
+static int portOpen(port_t * port, const char * device) {
+    port->rd = open(device, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (port->rd < 0) {
+        return -1;
+    }
+    port->wr = open(device, O_WRONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (port->wr < 0) {
+        close(port->rd);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Serve the port until it is closed
+ * @param port
+ */
+static void portRun(port_t * port) {
+    struct pollfd fds[2];
+    int count;
+
+    for (;;) {
+        /* input waiting for a full buffer is read after the responses */
+        fds[0].fd = (port->rx_full && port->tx_full) ? -1 : port->rd;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = port->tx_full ? port->wr : -1;
+        fds[1].events = POLLOUT;
+        fds[1].revents = 0;
+
+        count = poll(fds, 2, port->end_pending ? port->vtime * 100 : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("poll");
+            return;
+        }
+
+        /* the last read ended exactly at VMIN, followed by a pause */
+        if (count == 0) {
+            port->session->SCPI_InputEnd();
+            port->end_pending = false;
+            if (!portWrite(port)) {
+                return;
+            }
+            continue;
+        }
+
+        if (fds[1].revents & (POLLOUT | POLLERR)) {
+            if (!portWrite(port)) {
+                return;
+            }
+        }
+        if ((fds[0].revents & (POLLIN | POLLHUP | POLLERR)) || (port->rx_full && !port->tx_full)) {
+            if (!portRead(port)) {
+                return;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    port_t port;
+    const char * device = NULL;
+    speed_t speed = B0;
+    int baud = SERVER_BAUD;
+    int vmin = -1;
+    int vtime = -1;
+    bool xonxoff = false;
+    int i;
+
+    port.mode = PORT_LF;
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            baud = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "crlf") == 0) {
+                port.mode = PORT_CRLF;
+            } else if (strcmp(argv[i], "eoi") == 0) {
+                port.mode = PORT_EOI;
+            } else {
+                port.mode = PORT_LF;
+            }
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            vmin = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+            vtime = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0) {
+            xonxoff = true;
+        } else {
+            device = argv[i];
+        }
+    }
+
+    if (device == NULL) {
+        fprintf(stderr, "usage: %s [-b baud] [-t lf|crlf|eoi] [-m vmin] [-g vtime] [-x] device\n", argv[0]);
+        return 2;
+    }
+    for (i = 0; port_speeds[i].baud != 0; i++) {
+        if (port_speeds[i].baud == baud) {
+            speed = port_speeds[i].speed;
+        }
+    }
+    if (speed == B0) {
+        fprintf(stderr, "unsupported baud rate %d\n", baud);
+        return 2;
+    }
+
+    /* line modes return what is available, EOI emulation needs the pause */
+    if (vmin < 0) {
+        vmin = (port.mode == PORT_EOI) ? SERVER_EOI_VMIN : 1;
+    }
+    if (vtime < 0) {
+        vtime = (port.mode == PORT_EOI) ? SERVER_EOI_VTIME : 0;
+    }
+    if (port.mode == PORT_EOI && (vmin < 1 || vtime < 1)) {
+        fprintf(stderr, "EOI emulation needs vmin and vtime above 0\n");
+        return 2;
+    }
+    if (vmin > 255 || vtime > 255) {
+        fprintf(stderr, "vmin and vtime are at most 255\n");
+        return 2;
+    }
+
+    if (portOpen(&port, device) < 0 || portSetup(port.rd, speed, vmin, vtime, xonxoff) < 0) {
+        perror(device);
+        return 1;
+    }
+
+    SCPICore::SCPI_InstrumentInit(&server_instrument, server_commands);
+    port.session = new SCPISession(&server_instrument);
+    port.session->SCPI_Init();
+    port.session->SCPI_ResponseTerminator((port.mode == PORT_CRLF) ? "\r\n" : "\n");
+    port.vmin = vmin;
+    port.vtime = vtime;
+    port.rx_full = false;
+    port.tx_full = false;
+    port.end_pending = false;
+
+    portRun(&port);
+
+    delete port.session;
+    close(port.wr);
+    close(port.rd);
+    return 0;
+}
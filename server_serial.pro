@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# SCPI server on RS-232 port or pseudo-terminal, termios
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-server-serial
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += server_serial.cpp
+
+include(scpicore.pri)
@@ -0,0 +1,136 @@
+/**
+ * @file   server_shm.cpp
+ *
+ * @brief  SCPI service for clients on the same host, shared memory
+ *         transport
+ *
+ * Input buffer of the session is a window over the command ring and its
+ * output queue a window over the response ring, so commands are parsed
+ * where the client wrote them and responses (block data too) are written
+ * once, directly where the client reads them. No system call is made
+ * while both sides keep running, the service sleeps on its doorbell only
+ * after a short spin.
+ *
+ * One client at a time, it opens the segment with SCPISharedMemory::open.
+ *
+ * Usage: scpi-server-shm [name]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scpishm.h"
+#include "scpicore.h"
+
+#define SERVER_NAME "/scpi"
+
+static const SCPICore::scpi_command_t server_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t server_instrument;
+static SCPISharedMemory server_shm;
+
+/* positions of the rings as seen by the session
+ * committed - command bytes passed to the session
+ * consumed - response bytes released from the output queue */
+struct session_state_t {
+    uint32_t committed;
+    uint32_t consumed;
+};
+
+/**
+ * Move the session forward: release responses read by the client, pass
+ * new commands, give processed commands back and publish new responses
+ * @param session
+ * @param state
+ * @return true if anything changed
+ */
+static bool sessionStep(SCPICore * session, session_state_t * state) {
+    const char * data;
+    uint32_t read = server_shm.responseRead();
+    uint32_t written = server_shm.commandWritten();
+    uint32_t len;
+    size_t room;
+    bool progress = false;
+
+    /* read responses let waiting commands continue */
+    if (read != state->consumed) {
+        session->SCPI_OutputConsume(read - state->consumed);
+        state->consumed = read;
+        progress = true;
+    }
+
+    /* checks overrun of too long command line too */
+    session->SCPI_InputBuffer(&room);
+    if (written != state->committed) {
+        len = written - state->committed;
+        if (len > room) {
+            len = room;
+        }
+        session->SCPI_InputCommit(len);
+        state->committed += len;
+        session->SCPI_InputBuffer(&room);
+        progress = true;
+    }
+
+    /* bytes still in the input window are kept by the client */
+    server_shm.commandRelease(state->committed - (server_shm.ringSize() - 1 - room));
+    server_shm.responsePublish(state->consumed + session->SCPI_OutputPeek(&data));
+    return progress;
+}
+
+static void serverStop(int sig) {
+    (void) sig;
+    server_shm.close();
+    _exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    const char * name = (argc > 1) ? argv[1] : SERVER_NAME;
+    session_state_t state = {0, 0};
+    SCPICore * session;
+    uint32_t seen;
+
+    SCPICore::SCPI_InstrumentInit(&server_instrument, server_commands);
+
+    if (server_shm.create(name) < 0) {
+        perror("shm");
+        return 1;
+    }
+    signal(SIGINT, serverStop);
+    signal(SIGTERM, serverStop);
+
+    session = new SCPISession(&server_instrument);
+    session->SCPI_Init();
+    session->SCPI_InputAttach(server_shm.commandRing(), server_shm.ringSize());
+    session->SCPI_OutputAttach(server_shm.responseRing(), server_shm.ringSize());
+
+    for (;;) {
+        seen = server_shm.serviceBell();
+        if (!sessionStep(session, &state)) {
+            server_shm.serviceWait(seen);
+        }
+    }
+
+    return 0;
+}
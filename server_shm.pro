@@ -0,0 +1,24 @@
+#-------------------------------------------------
+#
+# Shared memory SCPI service, Linux
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-server-shm
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+LIBS += -lrt
+
+
+SOURCES += server_shm.cpp \
+    scpishm.cpp
+
+HEADERS += \
+    scpishm.h
+
+include(scpicore.pri)
@@ -0,0 +1,436 @@
+/**
+ * @file   server_uring.cpp
+ *
+ * @brief  Raw socket SCPI server driven by io_uring
+ *
+ * Same sessions as server_epoll.cpp, but readiness is not polled: receive
+ * and send are submitted to the kernel and their completions are handled.
+ * Operations of all connections are submitted together with waiting for
+ * completions by one io_uring_enter.
+ *
+ * Data are received directly to the input buffer of the session. The input
+ * buffer is compacted when commands are processed, so receive is queued
+ * only while the session waits for more input. If the response being sent
+ * is the last one, receive is linked to the send, so a query costs one
+ * io_uring_enter.
+ *
+ * The kernel interface is used directly (linux/io_uring.h), no liburing.
+ *
+ * Usage: scpi-server-uring [port]
+ */
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "scpicore.h"
+
+#define SERVER_PORT 5025
+#define SERVER_SQ_ENTRIES 4096
+#define SERVER_CQ_ENTRIES 32768
+
+/* operation of user_data, stored in low bits of connection pointer */
+#define SERVER_OP_ACCEPT 0
+#define SERVER_OP_RECV 1
+#define SERVER_OP_SEND 2
+#define SERVER_OP_MASK 3
+
+/* connection state
+ * inflight - number of queued operations
+ * sending - length of linked send without completion entry on success
+ * failed - connection is closed when the last operation completes */
+struct connection_t {
+    int fd;
+    SCPICore * session;
+    int inflight;
+    size_t sending;
+    bool failed;
+};
+
+/* mapped submission and completion queues */
+struct uring_t {
+    int fd;
+    unsigned * sq_head;
+    unsigned * sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned * sq_array;
+    struct io_uring_sqe * sqes;
+    unsigned * cq_head;
+    unsigned * cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe * cqes;
+    unsigned queued;
+    unsigned features;
+};
+
+static const SCPICore::scpi_command_t server_commands[] = {
+    {"*CLS", &SCPICore::SCPI_CoreCls,},
+    {"*ESE", &SCPICore::SCPI_CoreEse,},
+    {"*ESE?", &SCPICore::SCPI_CoreEseQ,},
+    {"*ESR?", &SCPICore::SCPI_CoreEsrQ,},
+    {"*IDN?", &SCPICore::SCPI_CoreIdnQ,},
+    {"*OPC", &SCPICore::SCPI_CoreOpc,},
+    {"*OPC?", &SCPICore::SCPI_CoreOpcQ,},
+    {"*RST", &SCPICore::SCPI_CoreRst,},
+    {"*SRE", &SCPICore::SCPI_CoreSre,},
+    {"*SRE?", &SCPICore::SCPI_CoreSreQ,},
+    {"*STB?", &SCPICore::SCPI_CoreStbQ,},
+    {"*TST?", &SCPICore::SCPI_CoreTstQ,},
+    {"*WAI", &SCPICore::SCPI_CoreWai,},
+
+    {"SYSTem:ERRor:ALL?", &SCPICore::SCPI_SystemErrorAllQ,},
+    {"SYSTem:ERRor[:NEXT]?", &SCPICore::SCPI_SystemErrorNextQ,},
+
+    SCPI_CMD_LIST_END
+};
+
+static SCPICore::scpi_instrument_t server_instrument;
+static struct uring_t ring;
+static int listener;
+/* accept stays armed for many connections (Linux 5.19) */
+static bool accept_multishot = true;
+
+/**
+ * Create the rings and map them to the process
+ * @param sq_entries - size of submission queue
+ * @param cq_entries - size of completion queue
+ * @return 0 on success, -1 on error
+ */
+static int uringInit(unsigned sq_entries, unsigned cq_entries) {
+    struct io_uring_params params;
+    size_t sq_size;
+    size_t cq_size;
+    char * sq;
+    char * cq;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = cq_entries;
+    ring.fd = syscall(__NR_io_uring_setup, sq_entries, &params);
+    if (ring.fd < 0) {
+        return -1;
+    }
+
+    sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_size = cq_size = (sq_size > cq_size) ? sq_size : cq_size;
+    }
+
+    sq = (char *) mmap(NULL, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) {
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+    } else {
+        cq = (char *) mmap(NULL, cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+        if (cq == MAP_FAILED) {
+            return -1;
+        }
+    }
+    ring.sqes = (struct io_uring_sqe *) mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) {
+        return -1;
+    }
+
+    ring.sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring.sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring.sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring.sq_entries = params.sq_entries;
+    ring.sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring.cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring.cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring.cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    ring.queued = 0;
+    ring.features = params.features;
+    return 0;
+}
+
+/**
+ * Submit queued operations and optionally wait for a completion
+ * @param wait - minimal number of completions
+ * @return result of io_uring_enter
+ */
+static int uringEnter(unsigned wait) {
+    int result;
+
+    result = syscall(__NR_io_uring_enter, ring.fd, ring.queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (result >= 0) {
+        ring.queued -= result;
+    }
+    return result;
+}
+
+/**
+ * Get free submission queue entry, submits queued ones if the queue is full
+ * @param user_data - connection and operation
+ * @return cleared entry, visible to the kernel at next uringEnter
+ */
+static struct io_uring_sqe * uringQueue(uint64_t user_data) {
+    unsigned tail = *ring.sq_tail;
+    unsigned index;
+    struct io_uring_sqe * sqe;
+
+    while (tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) >= ring.sq_entries) {
+        uringEnter(0);
+    }
+
+    index = tail & ring.sq_mask;
+    sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.queued++;
+    return sqe;
+}
+
+static void queueAccept() {
+    struct io_uring_sqe * sqe = uringQueue(SERVER_OP_ACCEPT);
+
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listener;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    if (accept_multishot) {
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    }
+}
+
+static struct io_uring_sqe * queueRecv(connection_t * conn, char * data, size_t len) {
+    struct io_uring_sqe * sqe = uringQueue((uint64_t) (uintptr_t) conn | SERVER_OP_RECV);
+
+    conn->inflight++;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t) (uintptr_t) data;
+    sqe->len = len;
+    return sqe;
+}
+
+static struct io_uring_sqe * queueSend(connection_t * conn, const char * data, size_t len) {
+    struct io_uring_sqe * sqe = uringQueue((uint64_t) (uintptr_t) conn | SERVER_OP_SEND);
+
+    conn->inflight++;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = conn->fd;
+    sqe->addr = (uint64_t) (uintptr_t) data;
+    sqe->len = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    return sqe;
+}
+
+static void connectionClose(connection_t * conn) {
+    close(conn->fd);
+    delete conn->session;
+    delete conn;
+}
+
+/**
+ * Queue next operations of the connection: send responses from output
+ * queue, receive to input buffer if the session waits for input. Output
+ * queue is not changed until the send completes, session is blocked
+ * meanwhile.
+ * @param conn
+ */
+static void connectionNext(connection_t * conn) {
+    const char * response;
+    char * buffer;
+    size_t len;
+
+    len = conn->session->SCPI_OutputPeek(&response);
+    if (len > 0) {
+        struct io_uring_sqe * sqe = queueSend(conn, response, len);
+        if (!conn->session->SCPI_InputIdle()) {
+            return;
+        }
+
+        /* receive starts when whole response is sent. With MSG_WAITALL
+         * short send fails and cancels it, otherwise it would break only
+         * on error. Successful send is then known from the receive
+         * completion. */
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe->msg_flags |= MSG_WAITALL;
+        if (ring.features & IORING_FEAT_CQE_SKIP) {
+            sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+            conn->sending = len;
+        }
+    }
+
+    /* buffer without complete command line always has room, too long
+     * line is discarded */
+    buffer = conn->session->SCPI_InputBuffer(&len);
+    queueRecv(conn, buffer, len);
+}
+
+/**
+ * Handle one completion
+ * @param cqe
+ */
+static void serverComplete(const struct io_uring_cqe * cqe) {
+    connection_t * conn = (connection_t *) (uintptr_t) (cqe->user_data & ~(uint64_t) SERVER_OP_MASK);
+    int one = 1;
+
+    if ((cqe->user_data & SERVER_OP_MASK) != SERVER_OP_ACCEPT) {
+        conn->inflight--;
+        if (conn->sending > 0 && (cqe->user_data & SERVER_OP_MASK) == SERVER_OP_RECV
+                && cqe->res != -ECANCELED) {
+            /* linked send completed in full without completion entry,
+             * failed or short send has its own one */
+            conn->inflight--;
+            conn->session->SCPI_OutputConsume(conn->sending);
+            conn->sending = 0;
+        }
+        if (cqe->res < 0 && cqe->res != -ECANCELED) {
+            conn->failed = true;
+        }
+        if (conn->failed) {
+            if (conn->inflight == 0) {
+                connectionClose(conn);
+            }
+            return;
+        }
+    }
+
+    switch (cqe->user_data & SERVER_OP_MASK) {
+        case SERVER_OP_ACCEPT:
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                if (cqe->res == -EINVAL && accept_multishot) {
+                    accept_multishot = false;
+                }
+                queueAccept();
+            }
+            if (cqe->res < 0) {
+                break;
+            }
+            setsockopt(cqe->res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            conn = new connection_t;
+            conn->fd = cqe->res;
+            conn->session = new SCPISession(&server_instrument);
+            conn->session->SCPI_Init();
+            conn->inflight = 0;
+            conn->sending = 0;
+            conn->failed = false;
+            connectionNext(conn);
+            break;
+
+        case SERVER_OP_RECV:
+            if (cqe->res == 0) {
+                /* closed by peer */
+                connectionClose(conn);
+                break;
+            }
+            if (cqe->res > 0) {
+                conn->session->SCPI_InputCommit(cqe->res);
+            }
+            /* canceled by short linked send otherwise, the later of both
+             * completions continues */
+            if (conn->inflight == 0) {
+                connectionNext(conn);
+            }
+            break;
+
+        case SERVER_OP_SEND:
+            /* only part of the response may be sent */
+            conn->sending = 0;
+            if (cqe->res > 0) {
+                conn->session->SCPI_OutputConsume(cqe->res);
+            }
+            /* linked receive is still queued */
+            if (conn->inflight == 0) {
+                connectionNext(conn);
+            }
+            break;
+    }
+}
+
+/**
+ * Create listening socket
+ * @param port - TCP port
+ * @return socket or -1
+ */
+static int serverListen(int port) {
+    struct sockaddr_in addr;
+    int fd;
+    int one = 1;
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Raise limit of open descriptors to the hard limit, each connection
+ * needs one
+ */
+static void serverRaiseLimit() {
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int port = (argc > 1) ? atoi(argv[1]) : SERVER_PORT;
+    unsigned head;
+    unsigned tail;
+
+    signal(SIGPIPE, SIG_IGN);
+    serverRaiseLimit();
+    SCPICore::SCPI_InstrumentInit(&server_instrument, server_commands);
+
+    listener = serverListen(port);
+    if (listener < 0) {
+        perror("listen");
+        return 1;
+    }
+    if (uringInit(SERVER_SQ_ENTRIES, SERVER_CQ_ENTRIES) < 0) {
+        perror("io_uring_setup");
+        return 1;
+    }
+
+    queueAccept();
+    for (;;) {
+        if (uringEnter(1) < 0 && errno != EINTR && errno != EBUSY) {
+            perror("io_uring_enter");
+            return 1;
+        }
+
+        head = *ring.cq_head;
+        tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            serverComplete(&ring.cqes[head & ring.cq_mask]);
+            head++;
+            /* release each entry, handler can queue and submit new ones */
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+        }
+    }
+
+    return 0;
+}
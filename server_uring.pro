@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Raw socket SCPI server (port 5025), Linux io_uring
+#
+#-------------------------------------------------
+
+CONFIG   -= qt
+
+TARGET = scpi-server-uring
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+
+SOURCES += server_uring.cpp
+
+include(scpicore.pri)
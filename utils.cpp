@@ -28,7 +28,7 @@
  */
 
 /**
- * @file   scpi_utils.c
+ * @file   utils.cpp
  * @date   Thu Nov 15 10:58:45 UTC 2012
  * 
  * @brief  Conversion routines and string manipulation routines
@@ -110,9 +110,110 @@ size_t longToStr(int32_t val, char * str, size_t len) {
  * @param len   string buffer length
  * @return number of bytes written to str (without '\0')
  */
+#if !SCPI_USE_FIXED_POINT
 size_t doubleToStr(double val, char * str, size_t len) {
     return snprintf(str, len, "%lg", val);
 }
+#endif
+
+/**
+ * Converts decimal number to string without floating point, positional
+ * notation for exponents of the first digit from -4 to 17 (as %lg up to
+ * its precision), otherwise scientific (1.5e+21), trailing zeros are not
+ * written
+ * @param mantissa
+ * @param exponent  decimal exponent, value is mantissa * 10^exponent
+ * @param str   converted textual representation, always terminated
+ * @param len   string buffer length
+ * @return number of bytes written to str (without '\0')
+ */
+size_t decimalToStr(int64_t mantissa, int16_t exponent, char * str, size_t len) {
+    char digits[20];
+    uint64_t val;
+    int count = 0;
+    int first;
+    int point;
+    int exp;
+    int i;
+    size_t pos = 0;
+
+    /* room for the terminator */
+    if (len == 0) {
+        return 0;
+    }
+    len--;
+
+    if (mantissa == 0) {
+        if (pos < len) str[pos++] = '0';
+        str[pos] = 0;
+        return pos;
+    }
+
+    if (mantissa < 0) {
+        val = (uint64_t) 0 - (uint64_t) mantissa;
+        if (pos < len) str[pos++] = '-';
+    } else {
+        val = (uint64_t) mantissa;
+    }
+
+    exp = exponent;
+    while ((val % 10) == 0) {
+        val /= 10;
+        exp++;
+    }
+    while (val > 0) {
+        digits[count++] = '0' + (char) (val % 10);
+        val /= 10;
+    }
+
+    /* digits are in reverse order, first is exponent of the leading digit */
+    first = count - 1 + exp;
+
+    if ((first >= -4) && (first < 18)) {
+        if (first < 0) {
+            if (pos < len) str[pos++] = '0';
+            if (pos < len) str[pos++] = '.';
+            for (i = first + 1; i < 0; i++) {
+                if (pos < len) str[pos++] = '0';
+            }
+            point = -1;
+        } else {
+            point = count - 1 - first;
+        }
+        for (i = count - 1; i >= 0; i--) {
+            if (pos < len) str[pos++] = digits[i];
+            if ((i == point) && (i > 0)) {
+                if (pos < len) str[pos++] = '.';
+            }
+        }
+        for (i = 0; i < exp; i++) {
+            if (pos < len) str[pos++] = '0';
+        }
+    } else {
+        if (pos < len) str[pos++] = digits[count - 1];
+        if ((count > 1) && (pos < len)) str[pos++] = '.';
+        for (i = count - 2; i >= 0; i--) {
+            if (pos < len) str[pos++] = digits[i];
+        }
+        if (pos < len) str[pos++] = 'e';
+        if (pos < len) str[pos++] = (first < 0) ? '-' : '+';
+        if (first < 0) {
+            first = -first;
+        }
+        /* at least two exponent digits, as %e */
+        count = 0;
+        do {
+            digits[count++] = '0' + (char) (first % 10);
+            first /= 10;
+        } while ((first > 0) || (count < 2));
+        while (count > 0) {
+            if (pos < len) str[pos++] = digits[--count];
+        }
+    }
+
+    str[pos] = 0;
+    return pos;
+}
 
 /**
  * Converts string to signed 32bit integer representation
@@ -132,11 +233,94 @@ size_t strToLong(const char * str, int32_t * val) {
  * @param val   double result
  * @return      number of bytes used in string
  */
+#if !SCPI_USE_FIXED_POINT
 size_t strToDouble(const char * str, double * val) {
     char * endptr;
     *val = strtod(str, &endptr);
     return endptr - str;
 }
+#endif
+
+/**
+ * Converts string to decimal number without floating point. Accepts
+ * decimal numeric program data: [sign] digits [. digits] [E [sign] digits].
+ * Digits over the 18 significant ones are dropped.
+ * @param str   string value
+ * @param mantissa  result, value is mantissa * 10^exponent
+ * @param exponent  result decimal exponent
+ * @return      number of bytes used in string, 0 if it is not a number
+ */
+size_t strToDecimal(const char * str, int64_t * mantissa, int16_t * exponent) {
+    const char * p = str;
+    int64_t val = 0;
+    int32_t exp = 0;
+    int32_t e = 0;
+    scpi_bool_t negative = FALSE;
+    scpi_bool_t e_negative = FALSE;
+    scpi_bool_t digits = FALSE;
+    const char * mark;
+
+    while (isspace((unsigned char) *p)) {
+        p++;
+    }
+    if ((*p == '+') || (*p == '-')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    for (; (*p >= '0') && (*p <= '9'); p++) {
+        digits = TRUE;
+        if (val < 100000000000000000LL) {
+            val = val * 10 + (*p - '0');
+        } else {
+            exp++;
+        }
+    }
+    if (*p == '.') {
+        p++;
+        for (; (*p >= '0') && (*p <= '9'); p++) {
+            digits = TRUE;
+            if (val < 100000000000000000LL) {
+                val = val * 10 + (*p - '0');
+                exp--;
+            }
+        }
+    }
+    if (!digits) {
+        *mantissa = 0;
+        *exponent = 0;
+        return 0;
+    }
+
+    /* exponent is used only if it has digits */
+    if ((*p == 'e') || (*p == 'E')) {
+        mark = p++;
+        if ((*p == '+') || (*p == '-')) {
+            e_negative = (*p == '-');
+            p++;
+        }
+        if ((*p >= '0') && (*p <= '9')) {
+            for (; (*p >= '0') && (*p <= '9'); p++) {
+                if (e < 10000) {
+                    e = e * 10 + (*p - '0');
+                }
+            }
+            exp += e_negative ? -e : e;
+        } else {
+            p = mark;
+        }
+    }
+
+    if (exp > INT16_MAX) {
+        exp = INT16_MAX;
+    } else if (exp < INT16_MIN) {
+        exp = INT16_MIN;
+    }
+
+    *mantissa = negative ? -val : val;
+    *exponent = (int16_t) exp;
+    return p - str;
+}
 
 /**
  * Compare two strings with exact length
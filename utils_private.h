@@ -41,7 +41,7 @@
 #include "config.h"
 
 typedef bool scpi_bool_t;
-#include <scpiparser.h>
+#include <scpicore.h>
 
 //#ifdef	__cplusplus
 //extern "C" {
@@ -56,9 +56,15 @@ typedef bool scpi_bool_t;
     const char * strnpbrk(const char *str, size_t size, const char *set) LOCAL;
     scpi_bool_t compareStr(const char * str1, size_t len1, const char * str2, size_t len2) LOCAL;
     size_t longToStr(int32_t val, char * str, size_t len) LOCAL;
+#if !SCPI_USE_FIXED_POINT
     size_t doubleToStr(double val, char * str, size_t len) LOCAL;
+#endif
+    size_t decimalToStr(int64_t mantissa, int16_t exponent, char * str, size_t len) LOCAL;
     size_t strToLong(const char * str, int32_t * val) LOCAL;
+#if !SCPI_USE_FIXED_POINT
     size_t strToDouble(const char * str, double * val) LOCAL;
+#endif
+    size_t strToDecimal(const char * str, int64_t * mantissa, int16_t * exponent) LOCAL;
     scpi_bool_t locateText(const char * str1, size_t len1, const char ** str2, size_t * len2) LOCAL;
     scpi_bool_t locateStr(const char * str1, size_t len1, const char ** str2, size_t * len2) LOCAL;
     size_t skipWhitespace(const char * cmd, size_t len) LOCAL;